@@ -0,0 +1,244 @@
+#include "checkers.h"
+
+/*
+	micro benchmarks, built without main.c into their own program:
+
+		make bench            builds checkers_bench and runs it
+		checkers_bench [search depth]
+
+	every benchmark runs on the same reference positions, and every result
+	is one JSON object on its own line, the last line has the totals and
+	the signature: the number of nodes the fixed depth searches took
+	(it only changes when the search itself does, so a different signature
+	means a different engine, and the same one means nps can be compared)
+*/
+
+typedef
+struct {
+	const char *name;
+	const char *fen;
+	int perft_depth;
+	int search_depth;
+} BenchPosition;
+
+static const BenchPosition BENCH_POSITIONS[] = {
+	{ "opening",    "B:W21,22,23,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,8,9,10,11,12",  9, 13 },
+	{ "middlegame", "B:W17,18,21,23,24,26,27,28,30,32:B1,2,3,5,7,8,9,10,11,14",           10, 13 },
+	{ "multijump",  "W:WK19,K27:B6,7,10,11,14,15,22,23,24",                               10, 13 },
+	{ "kingjumps",  "W:WK18:B6,7,14,15,22,23,24",                                         10, 15 },
+	{ "kings",      "B:WK3,K26,K29:BK12,K21,K32",                                          9, 13 },
+};
+
+#define BENCH_POSITIONS_LEN (sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]))
+
+// how many times the small operations are repeated on every position
+#define BENCH_OPS (1 << 20)
+
+// the playouts of the Monte Carlo bench on every position
+#define BENCH_PLAYOUTS (1 << 16)
+
+// keeps the compiler from dropping the work that's timed
+static volatile uint64_t bench_sink;
+
+static void
+bench_report(const char *bench, const char *position, uint64_t ops, double elapsed){
+	printf("{\"bench\":\"%s\",\"position\":\"%s\",\"ops\":%llu,\"seconds\":%.6f,\"ns_per_op\":%.2f}\n",
+	       bench, position, (unsigned long long)ops, elapsed, ops ? elapsed * 1e9 / ops : 0.0);
+}
+
+/* generate_moves, which is capture generation when the side to move has to take */
+static void
+bench_generate(const BenchPosition *b, const Position *pos){
+
+	MoveBuf buf;
+	uint64_t sum = 0;
+	double start = clock_seconds();
+
+	for (int i = 0; i<BENCH_OPS; ++i) {
+		generate_moves(pos, pos->turn, &buf);
+		sum += buf.len;
+	}
+
+	bench_report(taking_available(pos, pos->turn) ? "captures" : "generate", b->name,
+	             BENCH_OPS, clock_seconds() - start);
+	bench_sink += sum;
+}
+
+/* make_move followed by unmake_move, for every move in turn */
+static void
+bench_make_unmake(const BenchPosition *b, const Position *pos){
+
+	MoveBuf buf;
+	Position work = *pos;
+	uint64_t sum = 0;
+
+	generate_moves(pos, pos->turn, &buf);
+	if (buf.len == 0) return;
+
+	double start = clock_seconds();
+
+	for (int i = 0; i<BENCH_OPS; ++i) {
+		Undo undo;
+		Move m = buf.moves[i % buf.len];
+		make_move(&work, m, &undo);
+		sum += work.hash;
+		unmake_move(&work, m, &undo);
+	}
+
+	bench_report("make_unmake", b->name, BENCH_OPS, clock_seconds() - start);
+	bench_sink += sum;
+}
+
+/*
+	reading moves typed in square numbers, the way the protocol and the
+	book do it (parse_cmd lives in main.c, which isn't part of this program),
+	and reading the position's FEN
+*/
+static void
+bench_parse(const BenchPosition *b, const Position *pos){
+
+	MoveBuf buf;
+	char text[MAX_MOVES][8];
+	uint64_t sum = 0;
+
+	generate_moves(pos, pos->turn, &buf);
+	if (buf.len == 0) return;
+	for (int i = 0; i<buf.len; ++i)
+		move_format(buf.moves[i], text[i]);
+
+	double start = clock_seconds();
+	for (int i = 0; i<BENCH_OPS; ++i) {
+		Move m;
+		sum += book_match_move(pos, text[i % buf.len], &m);
+	}
+	bench_report("parse_move", b->name, BENCH_OPS, clock_seconds() - start);
+
+	start = clock_seconds();
+	for (int i = 0; i<BENCH_OPS / 16; ++i) {
+		Position p;
+		sum += position_from_fen(&p, b->fen);
+	}
+	bench_report("parse_fen", b->name, BENCH_OPS / 16, clock_seconds() - start);
+
+	bench_sink += sum;
+}
+
+static void
+bench_evaluate(const BenchPosition *b, const Position *pos){
+
+	int64_t sum = 0;
+	double start = clock_seconds();
+
+	for (int i = 0; i<BENCH_OPS; ++i)
+		sum += evaluate(pos);
+
+	bench_report("evaluate", b->name, BENCH_OPS, clock_seconds() - start);
+	bench_sink += sum;
+}
+
+static uint64_t
+bench_perft(const BenchPosition *b, const Position *pos, double *elapsed){
+
+	Position work = *pos;
+	double start = clock_seconds();
+	uint64_t nodes = perft(&work, b->perft_depth);
+
+	*elapsed = clock_seconds() - start;
+	printf("{\"bench\":\"perft\",\"position\":\"%s\",\"depth\":%d,\"nodes\":%llu,"
+	       "\"seconds\":%.6f,\"nps\":%.0f}\n",
+	       b->name, b->perft_depth, (unsigned long long)nodes, *elapsed,
+	       *elapsed > 0 ? nodes / *elapsed : 0.0);
+	return nodes;
+}
+
+/* one thread, an empty table and a fixed depth, so the node count never varies */
+static uint64_t
+bench_search(const BenchPosition *b, const Position *pos, Engine *engine, int depth, double *elapsed){
+
+	engine->limits.max_depth = depth > 0 ? depth : b->search_depth;
+	tt_clear();
+
+	SearchResult res = search(engine, pos);
+	char notation[8];
+
+	move_format(res.best, notation);
+	*elapsed = res.elapsed;
+	printf("{\"bench\":\"search\",\"position\":\"%s\",\"depth\":%d,\"nodes\":%llu,"
+	       "\"seconds\":%.6f,\"nps\":%.0f,\"best\":\"%s\",\"score\":%d}\n",
+	       b->name, res.depth, (unsigned long long)res.nodes, res.elapsed,
+	       res.elapsed > 0 ? res.nodes / res.elapsed : 0.0, notation, res.score);
+	return res.nodes;
+}
+
+/* UCT on one thread for a fixed number of playouts, the playout rate is what it's about */
+static uint64_t
+bench_mcts(const BenchPosition *b, const Position *pos, Engine *engine, double *elapsed){
+
+	engine->kind = ENGINE_UCT;
+	engine->limits.node_limit = BENCH_PLAYOUTS;
+
+	SearchResult res = search(engine, pos);
+	char notation[8];
+
+	engine->kind = ENGINE_ALPHABETA;
+	engine->limits.node_limit = 0;
+
+	move_format(res.best, notation);
+	*elapsed = res.elapsed;
+	printf("{\"bench\":\"mcts\",\"position\":\"%s\",\"playouts\":%llu,"
+	       "\"seconds\":%.6f,\"pps\":%.0f,\"best\":\"%s\"}\n",
+	       b->name, (unsigned long long)res.nodes, res.elapsed,
+	       res.elapsed > 0 ? res.nodes / res.elapsed : 0.0, notation);
+	return res.nodes;
+}
+
+int
+main(int argc, char *argv[]){
+
+	int depth = argc >= 2 ? atoi(argv[1]) : 0;
+	Engine engine;
+	uint64_t perft_nodes = 0, search_nodes = 0, playouts = 0;
+	double perft_time = 0, search_time = 0, mcts_time = 0;
+	double start = clock_seconds();
+
+	stats_init();
+	zobrist_init();
+	if (!tt_init(TT_DEFAULT_MB) || !engine_init(&engine, 1)) {
+		printf("Couldn't set up the engine\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i<BENCH_POSITIONS_LEN; ++i) {
+		const BenchPosition *b = &(BENCH_POSITIONS[i]);
+		Position pos;
+		double elapsed;
+
+		if (!position_from_fen(&pos, b->fen)) {
+			printf("Invalid FEN: %s\n", b->fen);
+			return 1;
+		}
+
+		bench_generate(b, &pos);
+		bench_make_unmake(b, &pos);
+		bench_parse(b, &pos);
+		bench_evaluate(b, &pos);
+
+		perft_nodes += bench_perft(b, &pos, &elapsed);
+		perft_time += elapsed;
+		search_nodes += bench_search(b, &pos, &engine, depth, &elapsed);
+		search_time += elapsed;
+		playouts += bench_mcts(b, &pos, &engine, &elapsed);
+		mcts_time += elapsed;
+	}
+
+	printf("{\"signature\":%llu,\"search_nps\":%.0f,\"perft_nodes\":%llu,\"perft_nps\":%.0f,"
+	       "\"mcts_pps\":%.0f,\"seconds\":%.3f}\n",
+	       (unsigned long long)search_nodes, search_time > 0 ? search_nodes / search_time : 0.0,
+	       (unsigned long long)perft_nodes, perft_time > 0 ? perft_nodes / perft_time : 0.0,
+	       mcts_time > 0 ? playouts / mcts_time : 0.0,
+	       clock_seconds() - start);
+
+	engine_free(&engine);
+	tt_free();
+	return 0;
+}
@@ -0,0 +1,885 @@
+#include <time.h>
+
+#include "checkers.h"
+
+/* BITBOARD HELPERS */
+
+/* moves every bit of "b" one square towards "d" */
+Bitboard
+bb_step(Bitboard b, DIRECTION d){
+	switch (d) {
+		case NW: return BB_NW(b);
+		case NE: return BB_NE(b);
+		case SW: return BB_SW(b);
+		case SE: return BB_SE(b);
+	}
+	return 0;
+}
+
+int
+bb_popcount(Bitboard b){
+	return __builtin_popcount(b);
+}
+
+// the lowest numbered square in "b" (b must not be empty)
+uint8_t
+bb_first_square(Bitboard b){
+	return __builtin_ctz(b) + 1;
+}
+
+/* ZOBRIST HASHING */
+
+/*
+	one random key for every (colour, king?, square) combination and one for the
+	side to move, a position's hash is the xor of the keys of everything on it
+	the keys come from a fixed seed so hashes are the same from run to run
+*/
+uint64_t ZOBRIST_PIECE[4][32];
+uint64_t ZOBRIST_TURN;
+
+uint64_t
+splitmix64(uint64_t *state){
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+void
+zobrist_init(void){
+
+	static bool initialised = false;
+	uint64_t seed = 0x636865636b657273ull;
+
+	if (initialised) return;
+
+	for (int p = 0; p<4; ++p)
+		for (int sq = 0; sq<32; ++sq)
+			ZOBRIST_PIECE[p][sq] = splitmix64(&seed);
+	ZOBRIST_TURN = splitmix64(&seed);
+
+	initialised = true;
+}
+
+// computes the hash from scratch (position_apply keeps it up to date after that)
+uint64_t
+position_hash(const Position *pos){
+
+	uint64_t hash = pos->turn == WHITE ? ZOBRIST_TURN : 0;
+
+	for (int color = BLACK; color<=WHITE; ++color) {
+		Bitboard b = pos->pieces[color];
+		while (b) {
+			uint8_t sq = bb_first_square(b);
+			b &= b - 1;
+			hash ^= ZOBRIST_PIECE[ZOBRIST_INDEX(color, pos->kings & SQ_BIT(sq))][sq - 1];
+		}
+	}
+
+	return hash;
+}
+
+/*
+	Compares two Moves for equality
+	the "ignore_taken" boolean can be provided to the function for it
+	to ignore what the moves take (and whether they crown)
+	(meaning it'll only compare where they start and end)
+*/
+bool
+move_equal(Move m1, Move m2, bool ignore_taken){
+	return ignore_taken ? MOVE_ENDS(m1) == MOVE_ENDS(m2) : m1 == m2;
+}
+
+/* Copies one Move into the other */
+void
+move_copy(Move m_from, Move *m_to){
+	*m_to = m_from;
+}
+
+/*
+	utility functions for the game history
+*/
+// forgets the whole game (the arrays are kept for the next one)
+void
+history_reset(History *h){
+	for (int i = 0; i<h->vars_len; ++i)
+		free(h->vars[i].plies);
+	h->len = 0;
+	h->cur = 0;
+	h->vars_len = 0;
+}
+
+// free all the memory acquired by the history
+void
+history_free(History *h){
+	history_reset(h);
+	free(h->plies);
+	free(h->vars);
+	memset(h, 0, sizeof *h);
+}
+
+static bool
+history_reserve(History *h, int len){
+
+	if (len <= h->cap) return true;
+
+	int cap = h->cap ? h->cap * 2 : 256;
+	while (cap < len) cap *= 2;
+
+	Ply *plies = realloc(h->plies, cap * sizeof(Ply));
+	if (plies == NULL) return false;
+
+	h->plies = plies;
+	h->cap = cap;
+	STAT_INC(STAT_HISTORY_GROW);
+	return true;
+}
+
+// keeps the plies after "cur" as a variation, they're cut from the game
+static void
+history_branch(History *h){
+
+	int len = h->len - h->cur - 1;
+	if (len <= 0) return;
+
+	Variation *vars = realloc(h->vars, (h->vars_len + 1) * sizeof(Variation));
+	Ply *plies = malloc(len * sizeof(Ply));
+	if (vars) h->vars = vars;
+	if (vars == NULL || plies == NULL) {
+		free(plies);
+		h->len = h->cur + 1;
+		return;
+	}
+
+	memcpy(plies, h->plies + h->cur + 1, len * sizeof(Ply));
+	h->vars[h->vars_len++] = (Variation){ h->cur, h->plies[h->cur].pos, plies, len };
+	h->len = h->cur + 1;
+}
+
+/*
+	records "m", played in "before" (the current ply's position)
+	the same move as the one that was taken back is a redo, anything else
+	starts a new line and keeps the old one as a variation
+*/
+void
+history_record(History *h, const Position *before, Move m){
+
+	if (h->len == 0) {
+		if (!history_reserve(h, 1)) return;
+		h->plies[0] = (Ply){ *before, MOVE_NONE };
+		h->len = 1;
+		h->cur = 0;
+	}
+
+	if (h->cur + 1 < h->len) {
+		if (h->plies[h->cur + 1].move == m) {
+			h->cur++;
+			return;
+		}
+		history_branch(h);
+	}
+
+	if (!history_reserve(h, h->cur + 2)) return;
+
+	Ply *ply = &(h->plies[++h->cur]);
+	ply->pos = *before;
+	ply->move = m;
+	position_apply(&(ply->pos), m);
+	h->len = h->cur + 1;
+}
+
+/*
+	utility functions for the move buffer
+*/
+void
+movebuf_clear(MoveBuf *buf){
+	buf->len = 0;
+}
+
+// add a move to the end of the buffer (moves past the capacity are dropped)
+void
+movebuf_append(MoveBuf *buf, Move m){
+	if (buf->len < MAX_MOVES)
+		buf->moves[buf->len++] = m;
+}
+
+// returns the Move from the buffer at position "index" (0 indexed)
+Move
+movebuf_get(const MoveBuf *buf, int index){
+	return buf->moves[index];
+}
+
+// returns the index of the first matching move, -1 if there is none
+int
+movebuf_find(const MoveBuf *buf, Move m, bool ignore_taken){
+	for (int i = 0; i<buf->len; ++i)
+		if (move_equal(buf->moves[i], m, ignore_taken))
+			return i;
+	return -1;
+}
+
+bool
+movebuf_contains(const MoveBuf *buf, Move m, bool ignore_taken){
+	return movebuf_find(buf, m, ignore_taken) >= 0;
+}
+
+/*
+	set the board up for a new game
+*/
+void
+setup_board(Position *pos){
+	pos->pieces[BLACK] = 0x00000FFFu;
+	pos->pieces[WHITE] = 0xFFF00000u;
+	pos->kings = 0;
+	pos->turn = BLACK;
+	zobrist_init();
+	pos->hash = position_hash(pos);
+}
+
+/*
+	the character the old board array would have held for a square:
+	'b' / 'w' for men, 'B' / 'W' for kings, ' ' for an empty square
+*/
+char
+piece_at(const Position *pos, uint8_t square){
+	Bitboard bit = SQ_BIT(square);
+	char piece;
+
+	if (pos->pieces[BLACK] & bit)      piece = 'b';
+	else if (pos->pieces[WHITE] & bit) piece = 'w';
+	else return ' ';
+
+	return (pos->kings & bit) ? piece & ~32 : piece;
+}
+
+/*
+	men can only move "forward": black goes south, white goes north
+	kings can go anywhere
+*/
+static Bitboard
+direction_pieces(const Position *pos, COLOR color, DIRECTION d){
+	bool forward = (color == BLACK) == (d == SW || d == SE);
+	return forward ? pos->pieces[color] : pos->pieces[color] & pos->kings;
+}
+
+// the pieces of "color" that have at least one non-taking move
+Bitboard
+movable_pieces(const Position *pos, COLOR color){
+	Bitboard empty = ~(pos->pieces[BLACK] | pos->pieces[WHITE]);
+	Bitboard movers = 0;
+
+	for (int d = 0; d<4; ++d)
+		movers |= direction_pieces(pos, color, d) & bb_step(empty, OPPOSITE_DIRECTION(d));
+
+	return movers;
+}
+
+// the pieces of "color" that can start a jump
+Bitboard
+capturing_pieces(const Position *pos, COLOR color){
+	Bitboard empty = ~(pos->pieces[BLACK] | pos->pieces[WHITE]);
+	Bitboard opp = pos->pieces[!color];
+	Bitboard jumpers = 0;
+
+	for (int d = 0; d<4; ++d) {
+		DIRECTION back = OPPOSITE_DIRECTION(d);
+		Bitboard over = bb_step(empty, back) & opp;
+		jumpers |= direction_pieces(pos, color, d) & bb_step(over, back);
+	}
+
+	return jumpers;
+}
+
+// checks if any piece of "color" has to take
+bool
+taking_available(const Position *pos, COLOR color) {
+	return capturing_pieces(pos, color) != 0;
+}
+
+/*
+	one jump of a capture sequence on the generator's stack:
+	the square the piece stands on, the next direction to try from it
+	and the piece it jumped to get there
+*/
+typedef
+struct {
+	uint8_t square;
+	uint8_t direction;
+	bool extended;
+	Bitboard jumped;
+} CaptureStep;
+
+/*
+	appends every capture sequence of the piece on "from" to the buffer
+
+	a depth first walk over the jumps with an explicit stack, so every
+	branch of a multi-jump comes out as its own move
+	pieces that have been jumped stay on the board until the move is over,
+	so they can't be jumped twice or landed on ("taken" masks them out)
+	a king can go round a loop either way and end up with the same move,
+	those only get added once
+*/
+static void
+generate_captures(const Position *pos, COLOR color, uint8_t from, MoveBuf *buf){
+
+	CaptureStep stack[MAX_CAPTURES + 1];
+	int first = buf->len;
+	int top = 0;
+
+	bool king = pos->kings & SQ_BIT(from);
+	Bitboard opp = pos->pieces[!color];
+	Bitboard crown = king ? 0 : (color == BLACK ? BB_ROW_1 : BB_ROW_8);
+	// the moving piece leaves its square, a king may come back to it
+	Bitboard empty = ~(pos->pieces[BLACK] | pos->pieces[WHITE]) | SQ_BIT(from);
+	Bitboard taken = 0;
+
+	stack[0] = (CaptureStep){ from, 0, false, 0 };
+
+	while (top >= 0) {
+
+		CaptureStep *step = &(stack[top]);
+
+		if (step->direction == 4) {
+			if (!step->extended && top > 0) {
+				Move m = MOVE_PACK(from, step->square, taken, SQ_BIT(step->square) & crown);
+				bool seen = false;
+				for (int i = first; i<buf->len && !seen; ++i)
+					seen = buf->moves[i] == m;
+				if (!seen)
+					movebuf_append(buf, m);
+			}
+			taken ^= step->jumped;
+			top--;
+			continue;
+		}
+
+		DIRECTION d = step->direction++;
+		if (!king && (color == BLACK) != (d == SW || d == SE)) continue;
+
+		Bitboard over = bb_step(SQ_BIT(step->square), d) & opp & ~taken;
+		Bitboard land = bb_step(over, d) & empty;
+		if (!land || top == MAX_CAPTURES) continue;
+
+		step->extended = true;
+		taken |= over;
+
+		// a man that reaches the last row gets crowned, which ends the move
+		stack[++top] = (CaptureStep){ bb_first_square(land), land & crown ? 4 : 0, false, over };
+	}
+}
+
+/*
+	fills the buffer with every legal move of "color"
+	if any piece can take, only the taking moves are legal
+*/
+void
+generate_moves(const Position *pos, COLOR color, MoveBuf *buf){
+
+	STAT_INC(STAT_GENERATE);
+	movebuf_clear(buf);
+
+	Bitboard empty = ~(pos->pieces[BLACK] | pos->pieces[WHITE]);
+	Bitboard jumpers = capturing_pieces(pos, color);
+
+	if (jumpers) {
+		while (jumpers) {
+			uint8_t square = bb_first_square(jumpers);
+			jumpers &= jumpers - 1;
+
+			generate_captures(pos, color, square, buf);
+		}
+		return;
+	}
+
+	Bitboard crown = color == BLACK ? BB_ROW_1 : BB_ROW_8;
+	Bitboard men = pos->pieces[color] & ~pos->kings;
+
+	for (int d = 0; d<4; ++d){
+
+		DIRECTION back = OPPOSITE_DIRECTION(d);
+		Bitboard targets = bb_step(direction_pieces(pos, color, d), d) & empty;
+
+		while (targets) {
+			Bitboard to = targets & -targets;
+			Bitboard from = bb_step(to, back);
+			targets &= targets - 1;
+
+			movebuf_append(buf, MOVE_PACK(bb_first_square(from), bb_first_square(to), 0,
+			                              (to & crown) && (from & men)));
+		}
+	}
+}
+
+/*
+	plays a move on the position without checking it
+	(the move has to come from generate_moves)
+	"undo" gets everything unmake_move needs to take it back:
+	the pieces that were taken, whether the piece got crowned and the old hash
+
+	the piece moves with an xor of from ^ to, so a king whose jumps
+	end where they started stays put
+*/
+void
+make_move(Position *pos, Move m, Undo *undo){
+
+	COLOR color = pos->turn;
+	Bitboard from = SQ_BIT(MOVE_FROM(m));
+	Bitboard to = SQ_BIT(MOVE_TO(m));
+	bool king = pos->kings & from;
+	uint64_t hash = pos->hash;
+
+	undo->hash = hash;
+	undo->captured = MOVE_TAKEN(m);
+	undo->promoted = MOVE_CROWNS(m);
+
+	hash ^= ZOBRIST_PIECE[ZOBRIST_INDEX(color, king)][MOVE_FROM(m) - 1];
+
+	pos->pieces[color] ^= from ^ to;
+	if (king)
+		pos->kings ^= from ^ to;
+	else if (undo->promoted) {
+		pos->kings |= to;
+		king = true;
+	}
+
+	hash ^= ZOBRIST_PIECE[ZOBRIST_INDEX(color, king)][MOVE_TO(m) - 1];
+
+	for (Bitboard taken = undo->captured; taken; taken &= taken - 1){
+		uint8_t sq = bb_first_square(taken);
+		hash ^= ZOBRIST_PIECE[ZOBRIST_INDEX(!color, pos->kings & SQ_BIT(sq))][sq - 1];
+	}
+
+	undo->captured_kings = undo->captured & pos->kings;
+	pos->pieces[!color] &= ~undo->captured;
+	pos->kings &= ~undo->captured;
+
+	pos->turn = !color;
+	pos->hash = hash ^ ZOBRIST_TURN;
+}
+
+/* takes back the last move made with make_move */
+void
+unmake_move(Position *pos, Move m, const Undo *undo){
+
+	COLOR color = !pos->turn;
+	Bitboard from = SQ_BIT(MOVE_FROM(m));
+	Bitboard to = SQ_BIT(MOVE_TO(m));
+
+	if (undo->promoted)
+		pos->kings &= ~to;
+	else if (pos->kings & to)
+		pos->kings ^= from ^ to;
+
+	pos->pieces[color] ^= from ^ to;
+	pos->pieces[!color] |= undo->captured;
+	pos->kings |= undo->captured_kings;
+
+	pos->turn = color;
+	pos->hash = undo->hash;
+}
+
+/* make_move for when the move won't be taken back */
+void
+position_apply(Position *pos, Move m){
+	Undo undo;
+	make_move(pos, m, &undo);
+}
+
+/*
+	reads a position in the PDN FEN notation, e.g. the starting position is
+	B:W21,22,23,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,8,9,10,11,12
+
+	the first letter says who moves, every other field lists the squares of one
+	colour, a 'K' in front of a square means a king and "N-M" means a range
+	returns false if the string doesn't make sense
+*/
+bool
+position_from_fen(Position *pos, const char *fen){
+
+	Position p = { { 0, 0 }, 0, BLACK, 0 };
+	const char *c = fen;
+
+	while (*c == ' ' || *c == '"') c++;
+
+	if ((*c | 32) == 'b')      p.turn = BLACK;
+	else if ((*c | 32) == 'w') p.turn = WHITE;
+	else return false;
+	c++;
+
+	while (*c == ':') {
+		c++;
+
+		COLOR color;
+		if ((*c | 32) == 'b')      color = BLACK;
+		else if ((*c | 32) == 'w') color = WHITE;
+		else return false;
+		c++;
+
+		while (*c != ':' && *c != '\0' && *c != '.' && *c != '"') {
+
+			bool king = false;
+			if (*c == ',') c++;
+			if ((*c | 32) == 'k') { king = true; c++; }
+
+			int first = 0, last;
+			if (*c < '0' || *c > '9') return false;
+			while (*c >= '0' && *c <= '9') first = first * 10 + (*c++ - '0');
+			last = first;
+
+			if (*c == '-') {
+				c++;
+				last = 0;
+				if (*c < '0' || *c > '9') return false;
+				while (*c >= '0' && *c <= '9') last = last * 10 + (*c++ - '0');
+			}
+
+			if (first < 1 || last > 32 || first > last) return false;
+
+			for (int sq = first; sq<=last; ++sq) {
+				p.pieces[color] |= SQ_BIT(sq);
+				if (king) p.kings |= SQ_BIT(sq);
+			}
+		}
+	}
+
+	if (p.pieces[BLACK] & p.pieces[WHITE]) return false;
+
+	zobrist_init();
+	p.hash = position_hash(&p);
+	*pos = p;
+	return true;
+}
+
+/* writes the position in FEN notation ("out" should have room for 128 characters) */
+void
+position_to_fen(const Position *pos, char *out){
+
+	out += sprintf(out, "%c", pos->turn == BLACK ? 'B' : 'W');
+
+	for (int color = WHITE; color >= BLACK; --color) {
+		out += sprintf(out, ":%c", color == BLACK ? 'B' : 'W');
+		bool first = true;
+		for (uint8_t sq = 1; sq<=32; ++sq) {
+			if (!(pos->pieces[color] & SQ_BIT(sq))) continue;
+			out += sprintf(out, "%s%s%d", first ? "" : ",",
+			               (pos->kings & SQ_BIT(sq)) ? "K" : "", sq);
+			first = false;
+		}
+	}
+}
+
+/*
+	the coordinates of the squares and the squares of the coordinates
+	(square 1 is b8 and square 32 is g1, the light squares are 0)
+*/
+static const char SQUARE_COL[33] = " bdfhacegbdfhacegbdfhacegbdfhaceg";
+
+static const uint8_t SQUARE_ROW[33] = {
+	0,
+	8, 8, 8, 8,
+	7, 7, 7, 7,
+	6, 6, 6, 6,
+	5, 5, 5, 5,
+	4, 4, 4, 4,
+	3, 3, 3, 3,
+	2, 2, 2, 2,
+	1, 1, 1, 1,
+};
+
+// indexed by [row - 1][column - 'a']
+static const uint8_t COORD_SQUARE[8][8] = {
+	{ 29,  0, 30,  0, 31,  0, 32,  0 },
+	{  0, 25,  0, 26,  0, 27,  0, 28 },
+	{ 21,  0, 22,  0, 23,  0, 24,  0 },
+	{  0, 17,  0, 18,  0, 19,  0, 20 },
+	{ 13,  0, 14,  0, 15,  0, 16,  0 },
+	{  0,  9,  0, 10,  0, 11,  0, 12 },
+	{  5,  0,  6,  0,  7,  0,  8,  0 },
+	{  0,  1,  0,  2,  0,  3,  0,  4 },
+};
+
+/*
+	turns the index of the square to coordinate values
+*/
+void
+square_to_coord(uint8_t square, char *col, uint8_t *row){
+	if (square < 1 || square > 32) return;
+	*col = SQUARE_COL[square];
+	*row = SQUARE_ROW[square];
+}
+
+/*
+	turns a pair of coordinates to the index of the square
+	(0 if it isn't a dark square of the board)
+*/
+uint8_t
+coord_to_square(char col, uint8_t row){
+	if (col < 'a' || col > 'h' || row < 1 || row > 8) return 0;
+	return COORD_SQUARE[row - 1][col - 'a'];
+}
+
+/* square number notation: "11-15" for simple moves and "15x22" for jumps */
+void
+move_format(Move m, char *out){
+	sprintf(out, "%d%c%d", MOVE_FROM(m), MOVE_TAKEN(m) ? 'x' : '-', MOVE_TO(m));
+}
+
+/*
+	the same, but captures are written with every square they land on ("15x22x29"),
+	two captures can start and end on the same squares and take different pieces
+	("out" needs room for 4 * (MAX_CAPTURES + 1) characters)
+*/
+void
+move_format_path(Move m, char *out){
+
+	uint8_t path[MAX_CAPTURES + 1];
+
+	if (MOVE_TAKEN(m) == 0) {
+		move_format(m, out);
+		return;
+	}
+
+	int n = move_path(m, path);
+	out += sprintf(out, "%d", path[0]);
+	for (int i = 1; i<n; ++i)
+		out += sprintf(out, "x%d", path[i]);
+}
+
+// the rest of a jump route from "square" over every piece in "left", see move_path
+static bool
+move_path_from(uint8_t square, Bitboard left, uint8_t to, uint8_t *squares, int n){
+
+	squares[n] = square;
+	if (left == 0) return square == to;
+
+	for (int d = 0; d<4; ++d) {
+		Bitboard over = bb_step(SQ_BIT(square), d) & left;
+		Bitboard land = bb_step(over, d) & ~left;
+		if (land && move_path_from(bb_first_square(land), left & ~over, to, squares, n + 1))
+			return true;
+	}
+	return false;
+}
+
+/*
+	the squares a move stands on from the first to the last, returns how many
+	("squares" needs room for MAX_CAPTURES + 1)
+	a move only knows which pieces it takes, so the jumps are found again,
+	this is for printing and doesn't have to be quick
+*/
+int
+move_path(Move m, uint8_t *squares){
+
+	int n = bb_popcount(MOVE_TAKEN(m));
+
+	if (n == 0 || !move_path_from(MOVE_FROM(m), MOVE_TAKEN(m), MOVE_TO(m), squares, 0)) {
+		squares[0] = MOVE_FROM(m);
+		squares[1] = MOVE_TO(m);
+		return 2;
+	}
+	return n + 1;
+}
+
+// monotonic wall clock time in seconds, used for all the timings
+double
+clock_seconds(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+	the legal moves of the game's position, from the cache if the
+	position hasn't changed since they were last worked out
+*/
+const LegalCache *
+legal_moves(GameCtx *gmctx){
+
+	LegalCache *legal = &(gmctx->legal);
+	const Position *pos = &(gmctx->pos);
+
+	if (legal->valid && legal->pos.hash == pos->hash && legal->pos.turn == pos->turn &&
+	    legal->pos.pieces[BLACK] == pos->pieces[BLACK] &&
+	    legal->pos.pieces[WHITE] == pos->pieces[WHITE] && legal->pos.kings == pos->kings)
+		return legal;
+
+	// only the old moves' entries are set, clearing those is enough
+	if (legal->valid)
+		for (int i = 0; i<legal->moves.len; ++i)
+			legal->index[MOVE_FROM(legal->moves.moves[i]) - 1][MOVE_TO(legal->moves.moves[i]) - 1] = 0;
+	else
+		memset(legal->index, 0, sizeof legal->index);
+
+	STAT_INC(STAT_LEGAL_REBUILDS);
+	legal->pos = *pos;
+	legal->valid = true;
+	legal->movers = 0;
+
+	generate_moves(pos, pos->turn, &(legal->moves));
+	legal->capture = legal->moves.len > 0 && MOVE_TAKEN(legal->moves.moves[0]) != 0;
+
+	for (int i = 0; i<legal->moves.len; ++i) {
+		uint8_t from = MOVE_FROM(legal->moves.moves[i]), to = MOVE_TO(legal->moves.moves[i]);
+		// two captures can share their ends, the first one stands for both
+		if (legal->index[from - 1][to - 1] == 0)
+			legal->index[from - 1][to - 1] = i + 1;
+		legal->movers |= SQ_BIT(from);
+	}
+
+	return legal;
+}
+
+/*
+	stores the legal moves of the piece on "square" in the context
+	(if the piece's side has to take somewhere else, that's none)
+	the side to move's come from the cache, the other side's are generated
+*/
+void
+available_moves(GameCtx *gmctx, uint8_t square){
+
+	MoveBuf *buf = &(gmctx->available_moves);
+	char piece = piece_at(&(gmctx->pos), square);
+	COLOR color = (piece | 32) == 'b' ? BLACK : WHITE;
+	const MoveBuf *all;
+
+	STAT_INC(STAT_AVAILABLE_MOVES);
+
+	if (color == gmctx->pos.turn) {
+		const LegalCache *legal = legal_moves(gmctx);
+		if (!(legal->movers & SQ_BIT(square))) {
+			movebuf_clear(buf);
+			return;
+		}
+		all = &(legal->moves);
+	}
+	else {
+		generate_moves(&(gmctx->pos), color, buf);
+		all = buf;
+	}
+
+	// keep only the moves of the piece (in place if they were just generated)
+	int len = 0;
+	for (int i = 0; i<all->len; ++i)
+		if (MOVE_FROM(all->moves[i]) == square)
+			buf->moves[len++] = all->moves[i];
+	buf->len = len;
+}
+
+// if there is no piece, returns false
+// otherwise computes the available moves and stores them in the context
+bool
+select_piece(GameCtx *gmctx, uint8_t square) {
+
+	if ( piece_at(&(gmctx->pos), square) == ' ' ) return false;
+
+	gmctx->selected_piece = square;
+	available_moves(gmctx, square);
+
+	return true;
+}
+
+// this executes the move (if it's correct)
+// and saves it in the game's history
+bool
+do_move(GameCtx *gmctx, Move m){
+
+	STAT_INC(STAT_DO_MOVE);
+
+	uint8_t from = MOVE_FROM(m), to = MOVE_TO(m);
+
+	if (from < 1 || from > 32 || to < 1 || to > 32) {
+		STAT_INC(STAT_ILLEGAL_MOVES);
+		return false;
+	}
+
+	// only the side to move's moves are in there
+	const LegalCache *legal = legal_moves(gmctx);
+	int index = legal->index[from - 1][to - 1] - 1;
+
+	// a move that knows what it takes has to be that very capture
+	// (two of them can share their ends), a typed in one gets the first
+	if (MOVE_TAKEN(m) != 0)
+		index = movebuf_find(&(legal->moves), m, false);
+	if (index < 0) {
+		STAT_INC(STAT_ILLEGAL_MOVES);
+		return false;
+	}
+
+	// the typed in move doesn't know what it takes, the generated one does
+	m = legal->moves.moves[index];
+	gmctx->selected_piece = from;
+
+	// the position was set some other way (a FEN), the history starts over there
+	History *h = &(gmctx->history);
+	if (h->len > 0 && h->plies[h->cur].pos.hash != gmctx->pos.hash)
+		history_reset(h);
+
+	history_record(h, &(gmctx->pos), m);
+	position_apply(&(gmctx->pos), m);
+
+	return true;
+}
+
+/* puts the game back (or forward) to "ply" of the line being played */
+bool
+history_goto(GameCtx *gmctx, int ply){
+
+	History *h = &(gmctx->history);
+
+	if (ply < 0 || ply >= h->len) return false;
+
+	h->cur = ply;
+	gmctx->pos = h->plies[ply].pos;
+	gmctx->selected_piece = 0;
+	movebuf_clear(&(gmctx->available_moves));
+
+	return true;
+}
+
+/*
+	makes variation "index" the line being played, the moves it replaces
+	become that variation, and the game goes to the variation's first move
+	the variation has to leave from a position the current line goes through
+*/
+bool
+history_variation(GameCtx *gmctx, int index){
+
+	History *h = &(gmctx->history);
+
+	if (index < 0 || index >= h->vars_len) return false;
+
+	Variation *v = &(h->vars[index]);
+	int ply = v->ply;
+	if (ply >= h->len) return false;
+
+	const Position *at = &(h->plies[ply].pos);
+	if (at->hash != v->base.hash || at->turn != v->base.turn || at->kings != v->base.kings ||
+	    at->pieces[BLACK] != v->base.pieces[BLACK] || at->pieces[WHITE] != v->base.pieces[WHITE])
+		return false;
+
+	int old_len = h->len - ply - 1;
+	Ply *old = old_len > 0 ? malloc(old_len * sizeof(Ply)) : NULL;
+
+	if ((old_len > 0 && old == NULL) || !history_reserve(h, ply + 1 + v->len)) {
+		free(old);
+		return false;
+	}
+	if (old_len > 0)
+		memcpy(old, h->plies + ply + 1, old_len * sizeof(Ply));
+
+	memcpy(h->plies + ply + 1, v->plies, v->len * sizeof(Ply));
+	h->len = ply + 1 + v->len;
+	free(v->plies);
+
+	// the line that was played is the variation now (unless it ended there)
+	if (old_len > 0) {
+		v->plies = old;
+		v->len = old_len;
+	}
+	else {
+		memmove(v, v + 1, (h->vars_len - index - 1) * sizeof(Variation));
+		h->vars_len--;
+	}
+
+	return history_goto(gmctx, ply + 1);
+}
@@ -0,0 +1,458 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkers.h"
+
+/*
+	the opening book
+
+	a file is a BookHeader followed by BookEntry records sorted by
+	(position hash, from, to, taken), so a position's moves sit next to each
+	other and can be found with a binary search right in the mapped file
+	an entry keeps what the move takes as well, so two captures with the
+	same ends are two different book moves
+*/
+
+#define BOOK_MAGIC   "CKBK"
+#define BOOK_VERSION 2
+
+#define BOOK_MAX_INPUTS 64
+
+typedef
+struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+} BookHeader;
+
+typedef
+struct {
+	uint64_t key;
+	uint8_t from;
+	uint8_t to;
+	uint16_t weight;
+	Bitboard taken;
+} BookEntry;
+
+static const BookHeader *book_header = NULL;
+static size_t book_mapped = 0;
+
+bool
+book_open(const char *path){
+
+	struct stat st;
+
+	book_close();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BookHeader)) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return false;
+
+	const BookHeader *h = map;
+	if (memcmp(h->magic, BOOK_MAGIC, 4) != 0 || h->version != BOOK_VERSION ||
+	    (size_t)st.st_size < sizeof(BookHeader) + h->count * sizeof(BookEntry)) {
+		munmap(map, st.st_size);
+		return false;
+	}
+
+	book_header = h;
+	book_mapped = st.st_size;
+	return true;
+}
+
+void
+book_close(void){
+	if (book_header)
+		munmap((void *)book_header, book_mapped);
+	book_header = NULL;
+	book_mapped = 0;
+}
+
+bool
+book_ready(void){
+	return book_header != NULL;
+}
+
+/*
+	the move "e" stands for in "pos", whether it crowns isn't kept in the
+	entry but a man that ends on the last row always does
+*/
+static Move
+entry_move(const Position *pos, const BookEntry *e){
+	Bitboard last = pos->turn == BLACK ? BB_ROW_1 : BB_ROW_8;
+	bool crowns = !(pos->kings & SQ_BIT(e->from)) && (SQ_BIT(e->to) & last);
+	return MOVE_PACK(e->from, e->to, e->taken, crowns);
+}
+
+/*
+	finds the book moves of the position that are legal in it
+	(a hash collision could bring up moves of some other position)
+	returns how many there are, at most "max"
+*/
+int
+book_moves(const Position *pos, Move *moves, int *weights, int max){
+
+	if (book_header == NULL) return 0;
+
+	const BookEntry *entries = (const BookEntry *)(book_header + 1);
+	uint64_t lo = 0, hi = book_header->count;
+
+	// the first entry with a key that isn't smaller
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (entries[mid].key < pos->hash) lo = mid + 1;
+		else hi = mid;
+	}
+
+	MoveBuf legal;
+	int n = 0;
+	generate_moves(pos, pos->turn, &legal);
+
+	for (uint64_t i = lo; i<book_header->count && entries[i].key == pos->hash && n < max; ++i) {
+		int index = movebuf_find(&legal, entry_move(pos, &(entries[i])), false);
+		if (index < 0 || entries[i].weight == 0) continue;
+		moves[n] = movebuf_get(&legal, index);
+		weights[n] = entries[i].weight;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+	picks one of the book moves, the more weight the more likely
+	"seed" is the caller's random state
+*/
+bool
+book_probe(const Position *pos, Move *m, uint64_t *seed){
+
+	Move moves[MAX_MOVES];
+	int weights[MAX_MOVES];
+	int total = 0;
+
+	int n = book_moves(pos, moves, weights, MAX_MOVES);
+	if (n == 0) return false;
+
+	for (int i = 0; i<n; ++i) total += weights[i];
+
+	// xorshift, good enough for picking a book move
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+
+	int pick = *seed % total;
+	for (int i = 0; i<n; ++i) {
+		if (pick < weights[i]) {
+			*m = moves[i];
+			return true;
+		}
+		pick -= weights[i];
+	}
+
+	*m = moves[n - 1];
+	return true;
+}
+
+/* BUILDING */
+
+// an entry while the book is built, with how many times its move was seen
+typedef
+struct {
+	BookEntry entry;
+	uint32_t seen;
+} BuildEntry;
+
+typedef
+struct {
+	BuildEntry *entries;
+	size_t len;
+	size_t cap;
+} BookBuilder;
+
+static bool
+builder_add(BookBuilder *b, uint64_t key, Move m, int weight){
+
+	if (b->len == b->cap) {
+		size_t cap = b->cap ? b->cap * 2 : 4096;
+		BuildEntry *entries = realloc(b->entries, cap * sizeof(BuildEntry));
+		if (entries == NULL) return false;
+		b->entries = entries;
+		b->cap = cap;
+	}
+
+	BuildEntry *e = &(b->entries[b->len++]);
+	memset(e, 0, sizeof *e);
+	e->entry.key = key;
+	e->entry.from = MOVE_FROM(m);
+	e->entry.to = MOVE_TO(m);
+	e->entry.taken = MOVE_TAKEN(m);
+	e->entry.weight = weight;
+	e->seen = 1;
+
+	return true;
+}
+
+static int
+entry_compare(const void *a, const void *b){
+	const BookEntry *x = a, *y = b;
+	if (x->key != y->key) return x->key < y->key ? -1 : 1;
+	if (x->from != y->from) return x->from - y->from;
+	if (x->to != y->to) return x->to - y->to;
+	if (x->taken != y->taken) return x->taken < y->taken ? -1 : 1;
+	return 0;
+}
+
+static int
+build_entry_compare(const void *a, const void *b){
+	return entry_compare(&(((const BuildEntry *)a)->entry), &(((const BuildEntry *)b)->entry));
+}
+
+/*
+	reads one move ("11-15", "15x22" or "15x22x29") off "text"
+	and finds the legal move it stands for
+	returns false at the end of the game or if the move is illegal
+*/
+bool
+book_match_move(const Position *pos, const char *text, Move *m){
+
+	uint8_t squares[MAX_CAPTURES + 1];
+	int n = 0;
+	const char *c = text;
+
+	while (n < MAX_CAPTURES + 1) {
+		if (*c < '0' || *c > '9') return false;
+		int sq = 0;
+		while (*c >= '0' && *c <= '9') sq = sq * 10 + (*c++ - '0');
+		if (sq < 1 || sq > 32) return false;
+		squares[n++] = sq;
+		if (*c != '-' && *c != 'x' && *c != 'X') break;
+		c++;
+	}
+	if (n < 2) return false;
+
+	MoveBuf legal;
+	generate_moves(pos, pos->turn, &legal);
+
+	for (int i = 0; i<legal.len; ++i) {
+		if (MOVE_FROM(legal.moves[i]) != squares[0] || MOVE_TO(legal.moves[i]) != squares[n - 1])
+			continue;
+		// with the squares in between, two captures with the same ends can be told apart
+		uint8_t path[MAX_CAPTURES + 1];
+		if (n > 2 && (move_path(legal.moves[i], path) != n || memcmp(path, squares, n) != 0))
+			continue;
+		*m = legal.moves[i];
+		return true;
+	}
+
+	return false;
+}
+
+/*
+	game records are read one game per line, with the moves in square
+	number notation separated by spaces, e.g.
+
+		1. 11-15 23-19 2. 8-11 22-17 ... 1-0
+
+	move numbers and {comments} are skipped, and "1-0", "0-1" or "1/2-1/2" at the end
+	tells who won (black's win is "1-0")
+	the first "plies" moves of every game go into the book, and
+	a move's weight is how often it was played, winning moves counting double
+	a line is as long as selfplay writes them at most, longer ones are skipped
+*/
+static int
+builder_read(BookBuilder *b, FILE *f, int plies){
+
+	char line[SELFPLAY_LINE];
+	int games = 0, too_long = 0;
+
+	while (fgets(line, sizeof line, f)) {
+
+		size_t len = strlen(line);
+		if (len == sizeof line - 1 && line[len - 1] != '\n') {
+			// the rest of it would read as a game of its own
+			int c;
+			while ((c = fgetc(f)) != EOF && c != '\n')
+				;
+			too_long++;
+			continue;
+		}
+
+		Position pos;
+		Move played[MAX_PLY];
+		uint64_t keys[MAX_PLY];
+		int n = 0;
+		int result = -1;	// the winner, -1 for a draw or unknown
+
+		setup_board(&pos);
+
+		for (char *tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+			if (strcmp(tok, "1-0") == 0)           { result = BLACK; break; }
+			if (strcmp(tok, "0-1") == 0)           { result = WHITE; break; }
+			if (strcmp(tok, "1/2-1/2") == 0)       break;
+			if (tok[strlen(tok) - 1] == '.')       continue;
+			if (tok[0] == '{')                     continue;
+			if (n >= plies || n >= MAX_PLY)        continue;
+
+			Move m;
+			if (!book_match_move(&pos, tok, &m)) break;
+
+			keys[n] = pos.hash;
+			played[n++] = m;
+			position_apply(&pos, m);
+		}
+
+		if (n == 0) continue;
+
+		for (int i = 0; i<n; ++i) {
+			// black moves on the even plies
+			COLOR mover = i % 2 == 0 ? BLACK : WHITE;
+			if (!builder_add(b, keys[i], played[i], result == (int)mover ? 2 : 1))
+				return -1;
+		}
+		games++;
+	}
+
+	if (too_long > 0)
+		printf("Skipped %d game records longer than %d characters\n", too_long, SELFPLAY_LINE - 2);
+
+	return games;
+}
+
+/*
+	reads the game records, merges the same moves of the same positions
+	and writes the sorted book to "out"
+	moves seen fewer than "min_count" times are left out
+*/
+bool
+book_build(const char *out, char *inputs[], int input_count, int plies, int min_count){
+
+	BookBuilder b = { NULL, 0, 0 };
+	int games = 0;
+
+	zobrist_init();
+
+	for (int i = 0; i<input_count; ++i) {
+		FILE *f = strcmp(inputs[i], "-") == 0 ? stdin : fopen(inputs[i], "r");
+		if (f == NULL) {
+			printf("Couldn't open %s\n", inputs[i]);
+			free(b.entries);
+			return false;
+		}
+		int read = builder_read(&b, f, plies);
+		if (f != stdin) fclose(f);
+		if (read < 0) {
+			free(b.entries);
+			return false;
+		}
+		games += read;
+	}
+
+	qsort(b.entries, b.len, sizeof(BuildEntry), build_entry_compare);
+
+	// merge the duplicates, adding up their weights and how often they were seen
+	size_t len = 0;
+	for (size_t i = 0; i<b.len; ++i) {
+		if (len > 0 && build_entry_compare(&(b.entries[len - 1]), &(b.entries[i])) == 0) {
+			uint32_t w = b.entries[len - 1].entry.weight + b.entries[i].entry.weight;
+			b.entries[len - 1].entry.weight = w > 0xFFFF ? 0xFFFF : w;
+			b.entries[len - 1].seen++;
+		}
+		else
+			b.entries[len++] = b.entries[i];
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i<len; ++i)
+		if (b.entries[i].seen >= (uint32_t)min_count)
+			b.entries[kept++] = b.entries[i];
+
+	BookHeader header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, BOOK_MAGIC, 4);
+	header.version = BOOK_VERSION;
+	header.count = kept;
+
+	FILE *f = fopen(out, "wb");
+	bool ok = f != NULL && fwrite(&header, sizeof header, 1, f) == 1;
+	for (size_t i = 0; ok && i<kept; ++i)
+		ok = fwrite(&(b.entries[i].entry), sizeof(BookEntry), 1, f) == 1;
+	if (f && fclose(f) != 0) ok = false;
+
+	printf("%d games, %zu moves read, %zu book entries written to %s\n", games, b.len, kept, out);
+
+	free(b.entries);
+	return ok;
+}
+
+/*
+	checkers book build <out> <games>... [-p plies] [-c min count]
+	checkers book probe <book> [FEN]
+*/
+int
+book_main(int argc, char *argv[]){
+
+	if (argc >= 4 && strcmp(argv[1], "build") == 0) {
+		int plies = 24, min_count = 1;
+		char *inputs[BOOK_MAX_INPUTS];
+		int n = 0;
+
+		for (int i = 3; i<argc; ++i) {
+			if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)      plies = atoi(argv[++i]);
+			else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) min_count = atoi(argv[++i]);
+			else if (n < BOOK_MAX_INPUTS)                         inputs[n++] = argv[i];
+			else {
+				printf("At most %d game files at a time\n", BOOK_MAX_INPUTS);
+				return 1;
+			}
+		}
+
+		return book_build(argv[2], inputs, n, plies, min_count) ? 0 : 1;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "probe") == 0) {
+		Position pos;
+		Move moves[MAX_MOVES];
+		int weights[MAX_MOVES];
+		char notation[4 * (MAX_CAPTURES + 1)];
+
+		setup_board(&pos);
+		if (argc >= 4 && !position_from_fen(&pos, argv[3])) {
+			printf("Invalid FEN: %s\n", argv[3]);
+			return 1;
+		}
+		if (!book_open(argv[2])) {
+			printf("Couldn't open the book %s\n", argv[2]);
+			return 1;
+		}
+
+		// time the lookup over a lot of runs, one is too quick to measure
+		int n = 0;
+		double start = clock_seconds();
+		for (int i = 0; i<10000; ++i)
+			n = book_moves(&pos, moves, weights, MAX_MOVES);
+		double elapsed = (clock_seconds() - start) / 10000;
+
+		for (int i = 0; i<n; ++i) {
+			move_format_path(moves[i], notation);
+			printf("%-12s weight %d\n", notation, weights[i]);
+		}
+		printf("%d book moves, lookup took %.2f us\n", n, elapsed * 1e6);
+
+		book_close();
+		return 0;
+	}
+
+	printf("usage: checkers book build <out> <games>... [-p plies] [-c min count]\n"
+	       "       checkers book probe <book> [FEN]\n");
+	return 1;
+}
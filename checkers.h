@@ -0,0 +1,627 @@
+#ifndef CHECKERS_H
+#define CHECKERS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* ASCII */
+#define ISDIGIT(x)	('1' <= x && x <= '8')
+#define ISALPHA(x)	( ('a' <= x && x <= 'h') || ('A' <= x && x <= 'H') )
+#define ISUPPERCASE(x)  ( x >= 'A' && x <= 'Z' )
+
+/* GAME CONSTANTS */
+
+/*
+	__1-__2-__3-__4-
+	5-__6-__7-__8-__
+	__9-__10__11__12
+	13__14__15__16__
+	__17__18__19__20
+	21__22__23__24__
+	__25__26__27__28
+	29__30__31__32__
+*/
+
+/* BITBOARDS */
+
+/*
+	bit (N-1) of a bitboard stands for square N
+	so square 1 is the least significant bit and 32 the most significant one
+*/
+typedef uint32_t Bitboard;
+
+#define SQ_BIT(S)	((Bitboard)1 << ((S)-1))
+
+/* the four squares of the rows starting with an empty (light) square */
+#define BB_EVEN_ROWS	0x0F0F0F0Fu
+/* the four squares of the rows starting with a playable (dark) square */
+#define BB_ODD_ROWS	0xF0F0F0F0u
+/* squares on the even rows that have a neighbour to the east */
+#define BB_EVEN_NOT_H	0x07070707u
+/* squares on the odd rows that have a neighbour to the west */
+#define BB_ODD_NOT_A	0xE0E0E0E0u
+
+/* where the men get crowned */
+#define BB_ROW_1	0xF0000000u
+#define BB_ROW_8	0x0000000Fu
+
+/*
+	these replace the old ADJ_SQUARES table:
+	they move every bit of a bitboard one square in the given direction,
+	bits that would fall off the board are dropped
+*/
+#define BB_NW(B)	( (((B) & BB_EVEN_ROWS)  >> 4) | (((B) & BB_ODD_NOT_A) >> 5) )
+#define BB_NE(B)	( (((B) & BB_EVEN_NOT_H) >> 3) | (((B) & BB_ODD_ROWS)  >> 4) )
+#define BB_SW(B)	( (((B) & BB_EVEN_ROWS)  << 4) | (((B) & BB_ODD_NOT_A) << 3) )
+#define BB_SE(B)	( (((B) & BB_EVEN_NOT_H) << 5) | (((B) & BB_ODD_ROWS)  << 4) )
+
+/* used to determine the next square when jumping */
+typedef
+enum {
+	NW,
+	NE,
+	SW,
+	SE,
+} DIRECTION;
+
+/* NW <-> SE and NE <-> SW */
+#define OPPOSITE_DIRECTION(D)	(3 - (D))
+
+typedef
+enum {
+	BLACK,
+	WHITE,
+} COLOR;
+
+/*
+	the whole position in three masks (and whose turn it is)
+	black sits on squares 1-12 at the start and moves first
+*/
+typedef
+struct {
+	Bitboard pieces[2];
+	Bitboard kings;
+	COLOR turn;
+	uint64_t hash;
+} Position;
+
+/* which of the four ZOBRIST_PIECE tables a piece uses */
+#define ZOBRIST_INDEX(COLOR, KING)	((COLOR) * 2 + ((KING) ? 1 : 0))
+
+extern uint64_t ZOBRIST_PIECE[4][32];
+extern uint64_t ZOBRIST_TURN;
+
+/* what make_move changed that unmake_move can't work out by itself */
+typedef
+struct {
+	Bitboard captured;
+	Bitboard captured_kings;
+	bool promoted;
+	uint64_t hash;
+} Undo;
+
+// a side only has 12 pieces to take
+#define MAX_CAPTURES 16
+
+/*
+	a move packed into one integer:
+
+		bits  0-31  the squares of the pieces it takes (a Bitboard)
+		bits 32-37  the square it starts from (1-32)
+		bits 38-43  the square it ends on
+		bit  44     the man gets crowned
+
+	0 is no move at all, two moves are the same move when the integers are
+	equal, and moves with the same ends have the same MOVE_ENDS
+	the squares jumped in between are worked out only for printing (move_path)
+*/
+typedef uint64_t Move;
+
+#define MOVE_NONE		((Move)0)
+#define MOVE_PACK(FROM, TO, TAKEN, CROWNS) \
+	((Move)(TAKEN) | (Move)(FROM) << 32 | (Move)(TO) << 38 | (Move)((CROWNS) ? 1 : 0) << 44)
+
+#define MOVE_FROM(M)		((uint8_t)(((M) >> 32) & 63))
+#define MOVE_TO(M)		((uint8_t)(((M) >> 38) & 63))
+#define MOVE_TAKEN(M)		((Bitboard)(M))
+#define MOVE_CROWNS(M)		((((M) >> 44) & 1) != 0)
+#define MOVE_ENDS(M)		((M) & ((Move)0xFFF << 32))
+
+/*
+	the moves generated for one position live in a fixed array on the stack,
+	so generating them never touches the heap
+	12 kings with 4 free squares each is the most non-taking moves a side can have,
+	taking sequences stay well below the capacity too
+*/
+#define MAX_MOVES 64
+
+typedef
+struct {
+	Move moves[MAX_MOVES];
+	int len;
+} MoveBuf;
+
+/* the search engine (and its threads), see further down */
+typedef struct engine Engine;
+
+/*
+	every legal move of the side to move in the game's position, worked out
+	once per ply: the move from "from" to "to" is moves[index[from-1][to-1] - 1]
+	(index is 0 if there isn't one)
+*/
+typedef
+struct {
+	Position pos;		// the position the moves belong to
+	bool valid;
+	bool capture;		// the moves take, so taking is mandatory
+	Bitboard movers;	// the pieces that have a move
+	MoveBuf moves;
+	uint8_t index[32][32];
+} LegalCache;
+
+/*
+	the game's history, in one array: ply N is the position after the
+	first N moves of the line being played (ply 0 is where it started)
+	and the move that led there, so going to any ply is one copy
+
+	plies after "cur" are the moves that were taken back, they come back
+	with redo, and playing something else there keeps them as a variation
+*/
+typedef
+struct {
+	Position pos;
+	Move move;		// MOVE_NONE at ply 0
+} Ply;
+
+/* a line that left the game after ply "ply", where the game was at "base" */
+typedef
+struct {
+	int ply;
+	Position base;
+	Ply *plies;
+	int len;
+} Variation;
+
+typedef
+struct {
+	Ply *plies;
+	int len;
+	int cap;
+	int cur;
+	Variation *vars;
+	int vars_len;
+} History;
+
+/*
+	storing all the relevant game data in one struct
+	the engine only ever gets a copy of the position, so the
+	game and the search threads never touch the same Position
+*/
+typedef
+struct {
+	Position pos;
+	bool player;
+	History history;
+	MoveBuf available_moves;
+	bool quit;
+	uint8_t selected_piece;
+	Engine *engine;
+	LegalCache legal;
+} GameCtx;
+
+/* board.c */
+Bitboard bb_step(Bitboard b, DIRECTION d);
+int      bb_popcount(Bitboard b);
+uint8_t  bb_first_square(Bitboard b);
+
+uint64_t splitmix64(uint64_t *state);
+void     zobrist_init(void);
+uint64_t position_hash(const Position *pos);
+
+bool move_equal(Move m1, Move m2, bool ignore_taken);
+void move_copy(Move m_from, Move *m_to);
+
+void history_reset(History *h);
+void history_free(History *h);
+void history_record(History *h, const Position *before, Move m);
+
+void movebuf_clear(MoveBuf *buf);
+void movebuf_append(MoveBuf *buf, Move m);
+Move movebuf_get(const MoveBuf *buf, int index);
+int  movebuf_find(const MoveBuf *buf, Move m, bool ignore_taken);
+bool movebuf_contains(const MoveBuf *buf, Move m, bool ignore_taken);
+
+void setup_board(Position *pos);
+char piece_at(const Position *pos, uint8_t square);
+Bitboard movable_pieces(const Position *pos, COLOR color);
+Bitboard capturing_pieces(const Position *pos, COLOR color);
+bool taking_available(const Position *pos, COLOR color);
+void generate_moves(const Position *pos, COLOR color, MoveBuf *buf);
+void make_move(Position *pos, Move m, Undo *undo);
+void unmake_move(Position *pos, Move m, const Undo *undo);
+void position_apply(Position *pos, Move m);
+
+bool position_from_fen(Position *pos, const char *fen);
+void position_to_fen(const Position *pos, char *out);
+void move_format(Move m, char *out);
+void move_format_path(Move m, char *out);
+int  move_path(Move m, uint8_t *squares);
+void square_to_coord(uint8_t square, char *col, uint8_t *row);
+uint8_t coord_to_square(char col, uint8_t row);
+double clock_seconds(void);
+
+const LegalCache *legal_moves(GameCtx *gmctx);
+void available_moves(GameCtx *gmctx, uint8_t square);
+bool select_piece(GameCtx *gmctx, uint8_t square);
+bool do_move(GameCtx *gmctx, Move m);
+bool history_goto(GameCtx *gmctx, int ply);
+bool history_variation(GameCtx *gmctx, int index);
+
+/* SEARCH */
+
+#define MAX_PLY   64
+#define MAX_DEPTH 48
+
+#define SCORE_WIN 30000
+#define SCORE_INF 32000
+/* tablebase wins sit below the wins the search found itself */
+#define SCORE_TB  20000
+/* anything beyond this is a win or loss counted in plies from some node */
+#define SCORE_DECISIVE (SCORE_TB - 1024)
+
+/* what the engine is allowed to spend on a move (0 means no limit) */
+typedef
+struct {
+	double time_limit;
+	uint64_t node_limit;
+	int max_depth;
+	bool verbose;
+} SearchLimits;
+
+typedef
+struct {
+	Move best;
+	int score;
+	int depth;
+	uint64_t nodes;
+	double elapsed;
+	Move pv[MAX_PLY];
+	int pv_len;
+	bool book;
+	// how long it took to finish each depth
+	double depth_time[MAX_DEPTH + 1];
+} SearchResult;
+
+/* TRANSPOSITION TABLE */
+
+#define TT_DEFAULT_MB 64
+#define TT_BUCKET 4
+
+/* what the stored score means */
+enum {
+	TT_NONE,
+	TT_UPPER,	// the score is at most this (nothing beat alpha)
+	TT_LOWER,	// the score is at least this (beta cutoff)
+	TT_EXACT,
+};
+
+/* one stored search result */
+typedef
+struct {
+	int16_t score;
+	int8_t depth;
+	uint8_t bound;
+	uint8_t generation;
+	Move move;		// only its ends (MOVE_ENDS), that's all the move ordering needs
+} TTEntry;
+
+/*
+	in the table an entry is packed into "data" and "check" is the key xor'd
+	with it: 16 bytes, so a bucket of 4 fills a cache line
+*/
+typedef
+struct {
+	uint64_t check;
+	uint64_t data;
+} TTSlot;
+
+typedef
+struct {
+	TTSlot slots[TT_BUCKET];
+} TTBucket;
+
+typedef
+struct {
+	uint64_t probes;
+	uint64_t hits;
+	uint64_t stores;
+	uint64_t overwrites;
+} TTStats;
+
+#define MAX_THREADS 64
+
+/* what kind of search the engine runs */
+enum { ENGINE_ALPHABETA, ENGINE_UCT, ENGINE_PUCT };
+
+/* the Monte Carlo search's tree (mcts.c) */
+typedef struct mcts_tree MctsTree;
+
+/* NNUE */
+
+#define NNUE_INPUTS (4 * 32)
+#define NNUE_L1     64
+#define NNUE_L2     32
+
+// the first layer's sums, from black's and from white's point of view
+typedef
+struct {
+	int16_t v[2][NNUE_L1];
+} NnueAccumulator;
+
+/*
+	everything one search thread needs to keep track of,
+	none of it is shared with the other threads
+*/
+typedef
+struct {
+	Engine *engine;
+	int id;
+	// the thread's own copy of the position, make/unmake move it around
+	Position pos;
+	uint64_t nodes;
+	uint64_t tb_hits;
+	TTStats tt;
+	Move pv[MAX_PLY][MAX_PLY];
+	int pv_len[MAX_PLY];
+	Move prev_pv[MAX_PLY];
+	int prev_pv_len;
+	bool follow_pv;
+	// the network's accumulator at every ply (when there is a network)
+	NnueAccumulator acc[MAX_PLY + 1];
+	Move killers[MAX_PLY][2];
+	int history[32][32];
+	SearchResult result;
+} SearchCtx;
+
+/*
+	the state the search threads share: the limits, the stop flag and
+	the node count of all of them (the transposition table is shared too)
+*/
+struct engine {
+	SearchLimits limits;
+	int threads;
+	atomic_bool stop;
+	atomic_uint_fast64_t nodes;
+	double start;
+	SearchCtx *workers;
+	// play straight from the opening book while it has moves
+	bool use_book;
+	uint64_t book_seed;
+	// ENGINE_ALPHABETA, or one of the Monte Carlo searches and their tree
+	int kind;
+	MctsTree *tree;
+};
+
+/* tt.c */
+bool   tt_init(size_t mb);
+void   tt_free(void);
+bool   tt_ready(void);
+size_t tt_size_bytes(void);
+void   tt_clear(void);
+void   tt_new_search(void);
+int    tt_score_to(int score, int ply);
+int    tt_score_from(int score, int ply);
+bool   tt_probe(uint64_t key, TTEntry *out, TTStats *stats);
+void   tt_store(uint64_t key, int depth, int bound, int score, Move best, TTStats *stats);
+int    tt_hashfull(void);
+void   tt_stats_add(TTStats *sum, const TTStats *stats);
+void   tt_print_stats(const TTStats *stats);
+
+/* ENDGAME TABLEBASES */
+
+#define TB_MAX_PIECES 8
+
+/*
+	a tablebase value is one byte:
+	0 is a draw, 1-126 a win in that many plies,
+	128-254 a loss in (value - 128) plies, 255 not a position
+*/
+#define TB_DRAW			0
+#define TB_INVALID		255
+#define TB_MAX_DISTANCE		126
+#define TB_WIN(D)		(D)
+#define TB_LOSS(D)		(128 + (D))
+#define TB_IS_WIN(V)		((V) >= 1 && (V) < 128)
+#define TB_IS_LOSS(V)		((V) >= 128 && (V) < TB_INVALID)
+#define TB_DISTANCE(V)		((V) & 127)
+
+/* tb.c */
+void tb_init(const char *dir, int pieces);
+void tb_close(void);
+int  tb_max_pieces(void);
+bool tb_probe(const Position *pos, uint8_t *value);
+int  tb_score(uint8_t value, int ply);
+bool tb_generate(const char *dir, int pieces, int threads);
+int  tb_main(int argc, char *argv[]);
+
+/* book.c */
+bool book_open(const char *path);
+void book_close(void);
+bool book_ready(void);
+int  book_moves(const Position *pos, Move *moves, int *weights, int max);
+bool book_probe(const Position *pos, Move *m, uint64_t *seed);
+bool book_match_move(const Position *pos, const char *text, Move *m);
+bool book_build(const char *out, char *inputs[], int input_count, int plies, int min_count);
+int  book_main(int argc, char *argv[]);
+
+/* eval.c */
+int evaluate(const Position *pos);
+
+/* nnue.c */
+bool nnue_load(const char *path);
+bool nnue_ready(void);
+void nnue_free(void);
+void nnue_refresh(const Position *pos, NnueAccumulator *acc);
+void nnue_update(const NnueAccumulator *before, NnueAccumulator *after, const Position *pos,
+                 Move m, const Undo *undo);
+int  nnue_evaluate(const NnueAccumulator *acc, COLOR turn);
+int  nnue_main(int argc, char *argv[]);
+
+/* search.c */
+void search_limits_default(SearchLimits *limits);
+bool engine_init(Engine *engine, int threads);
+void engine_free(Engine *engine);
+SearchResult search(Engine *engine, const Position *pos);
+void engine_print_threads(const Engine *engine, const SearchResult *res);
+int  smp_main(int argc, char *argv[]);
+
+/* mcts.c */
+SearchResult mcts_search(Engine *engine, const Position *pos);
+void mcts_free(Engine *engine);
+int  engine_kind(const char *name);
+const char *engine_kind_name(int kind);
+
+/* perft.c */
+uint64_t perft(Position *pos, int depth);
+uint64_t perft_divide(const Position *pos, int depth);
+bool perft_check(void);
+int  perft_main(int argc, char *argv[]);
+
+/* PDN */
+
+#define PDN_MAX_PLIES 1024
+
+// the result of a game, in the order of the PDN result texts
+enum { PDN_UNKNOWN, PDN_BLACK_WINS, PDN_WHITE_WINS, PDN_DRAW };
+// what pdn_next found
+enum { PDN_EOF, PDN_GAME, PDN_ILLEGAL };
+
+typedef
+struct {
+	const char *data;
+	size_t len;
+	size_t at;
+	bool owned;		// read from stdin into memory rather than mapped
+} PdnReader;
+
+typedef
+struct {
+	Position start;
+	bool fen;		// started from a FEN tag rather than the usual setup
+	int result;
+	int len;
+	Move moves[PDN_MAX_PLIES];
+	uint64_t keys[PDN_MAX_PLIES];	// the hash of the position in front of every move
+} PdnGame;
+
+/* pdn.c */
+bool pdn_open(PdnReader *r, const char *path);
+void pdn_close(PdnReader *r);
+int  pdn_next(PdnReader *r, PdnGame *game);
+bool pdn_write(FILE *f, const PdnGame *game, const char *event);
+int  pdn_main(int argc, char *argv[]);
+
+/* GAME DATABASE */
+
+/* what the games that played "move" from a position did, for the side that played it */
+typedef
+struct {
+	Move move;
+	uint32_t count;		// games with no result only count here
+	uint32_t wins;
+	uint32_t draws;
+	uint32_t losses;
+} DbMoveStats;
+
+/* gamedb.c */
+bool gamedb_open(const char *path);
+void gamedb_close(void);
+bool gamedb_ready(void);
+int  gamedb_moves(GameCtx *gmctx, DbMoveStats *moves, int max);
+void gamedb_print(GameCtx *gmctx);
+bool gamedb_build(const char *out, char *inputs[], int input_count, int threads, size_t mb);
+int  gamedb_main(int argc, char *argv[]);
+
+/* selfplay.c */
+#define SELFPLAY_MAX_PLIES 400
+// a game record line: a move number, a capture with its whole route and a score per ply
+#define SELFPLAY_LINE      (SELFPLAY_MAX_PLIES * (4 * (MAX_CAPTURES + 1) + 24) + 64)
+
+int selfplay_main(int argc, char *argv[]);
+
+/* protocol.c */
+int protocol_main(int argc, char *argv[]);
+
+/* solve.c */
+int solve_main(int argc, char *argv[]);
+
+/* server.c */
+int server_main(int argc, char *argv[]);
+int loadgen_main(int argc, char *argv[]);
+
+/* STATISTICS */
+
+/*
+	counters every thread keeps in its own thread local block, so counting
+	is a plain add with no sharing between the threads
+	building with -DNO_STATS ("make nostats") takes all of them out
+*/
+typedef
+enum {
+	STAT_GENERATE,		// generate_moves calls
+	STAT_LEGAL_REBUILDS,	// legal_moves calls that had to generate
+	STAT_AVAILABLE_MOVES,
+	STAT_DO_MOVE,
+	STAT_ILLEGAL_MOVES,	// do_move calls that were turned down
+	STAT_HISTORY_GROW,	// the game history had to get a bigger array
+	STAT_SEARCHES,
+	STAT_NODES,
+	STAT_CUTOFFS,
+	STAT_FIRST_CUTOFFS,	// cutoffs by the first move searched
+	STAT_TT_PROBES,
+	STAT_TT_HITS,
+	STAT_TT_CUTOFFS,
+	STAT_TB_HITS,
+	STAT_EVALS,
+	STAT_NNUE_EVALS,
+	STAT_NNUE_UPDATES,
+	STAT_SOLVE_NODES,
+	STAT_PLAYOUTS,		// random games the Monte Carlo search played
+	// the time spent in each phase, in nanoseconds
+	STAT_TIME_SEARCH,
+	STAT_TIME_PERFT,
+	STAT_TIME_RENDER,
+	STAT_TIME_INPUT,
+	STAT_COUNT
+} STAT;
+
+typedef
+struct stats_block {
+	uint64_t count[STAT_COUNT];
+	struct stats_block *next;
+	bool registered;
+} StatsBlock;
+
+#ifdef NO_STATS
+#define STAT_ADD(S, N)        ((void)0)
+// the clock readings the counters would have taken aren't unused variables
+#define STAT_TIME(S, START)   ((void)(START))
+#else
+extern _Thread_local StatsBlock stats_local;
+#define STAT_ADD(S, N)        (stats_local.count[S] += (N))
+#define STAT_TIME(S, START)   STAT_ADD(S, (uint64_t)((clock_seconds() - (START)) * 1e9))
+#endif
+#define STAT_INC(S)           STAT_ADD(S, 1)
+
+/* stats.c */
+void stats_init(void);
+void stats_thread_start(void);
+void stats_sum(uint64_t count[STAT_COUNT], int *threads);
+void stats_print(FILE *f);
+void stats_json(FILE *f);
+
+#endif
@@ -0,0 +1,46 @@
+#include "checkers.h"
+
+/*
+	the evaluation, in hundredths of a man, from the point of view
+	of the side to move
+*/
+
+#define EVAL_MAN	100
+#define EVAL_KING	130
+
+/* men get a bit more valuable the closer they are to crowning */
+const int ADVANCE_BONUS[8] = { 0, 0, 1, 2, 4, 6, 9, 0 };
+
+/* keeping the back row filled stops the other side from crowning */
+#define EVAL_BACK_ROW	4
+/* the four squares in the middle of the board */
+#define BB_CENTER	0x00066000u
+#define EVAL_CENTER	3
+
+static int
+eval_side(const Position *pos, COLOR color){
+
+	Bitboard men = pos->pieces[color] & ~pos->kings;
+	Bitboard kings = pos->pieces[color] & pos->kings;
+	Bitboard back_row = color == BLACK ? BB_ROW_8 : BB_ROW_1;
+	int score = 0;
+
+	score += EVAL_MAN * bb_popcount(men);
+	score += EVAL_KING * bb_popcount(kings);
+	score += EVAL_BACK_ROW * bb_popcount(men & back_row);
+	score += EVAL_CENTER * bb_popcount(pos->pieces[color] & BB_CENTER);
+
+	while (men) {
+		int row = (bb_first_square(men) - 1) / 4;
+		men &= men - 1;
+		score += ADVANCE_BONUS[color == BLACK ? row : 7 - row];
+	}
+
+	return score;
+}
+
+int
+evaluate(const Position *pos){
+	STAT_INC(STAT_EVALS);
+	return eval_side(pos, pos->turn) - eval_side(pos, !pos->turn);
+}
@@ -0,0 +1,617 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkers.h"
+
+/*
+	the game database: what was played from a position and how it went
+
+	a file is a DbHeader followed by DbEntry records sorted by
+	(position hash, move) like the opening book, one record for every
+	move played from a position with how often it was played and how many
+	of those games the side that played it won, drew and lost
+	it's searched in place in the mapped file, so a query is a binary
+	search and a few records next to each other
+
+	building it reads PDN archives (pdn.c, which checks every move) on all
+	the threads, every thread cuts the archive piece it got into runs that
+	fit its share of the memory, sorts and merges each one and writes it
+	to a file of its own, and at the end all the runs are merged into the
+	database, so the archives can be much bigger than the memory the
+	build has
+*/
+
+#define DB_MAGIC   "CKDB"
+#define DB_VERSION 2
+
+#define DB_DEFAULT_MB	256
+// archives are cut into pieces of at least this size, a few per thread
+#define DB_MIN_CHUNK	(1 << 20)
+#define DB_CHUNKS_PER_THREAD	4
+#define DB_MAX_INPUTS	64
+#define DB_MAX_CHUNKS	(DB_MAX_INPUTS * DB_CHUNKS_PER_THREAD * MAX_THREADS)
+#define DB_MAX_RUNS	4096
+// the buffer of every run while they're merged
+#define DB_RUN_BUFFER	(1 << 16)
+
+typedef
+struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+	uint64_t games;
+	uint64_t plies;
+} DbHeader;
+
+typedef
+struct {
+	uint64_t key;
+	// the whole packed Move, captures with the same ends are different moves
+	Move move;
+	uint32_t count;
+	// for the side that played the move (games without a result only count)
+	uint32_t wins;
+	uint32_t draws;
+	uint32_t losses;
+} DbEntry;
+
+static const DbHeader *db_header = NULL;
+static size_t db_mapped = 0;
+
+bool
+gamedb_open(const char *path){
+
+	struct stat st;
+
+	gamedb_close();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DbHeader)) {
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return false;
+
+	const DbHeader *h = map;
+	if (memcmp(h->magic, DB_MAGIC, 4) != 0 || h->version != DB_VERSION ||
+	    (size_t)st.st_size < sizeof(DbHeader) + h->count * sizeof(DbEntry)) {
+		munmap(map, st.st_size);
+		return false;
+	}
+	// the queries jump around in it
+	madvise(map, st.st_size, MADV_RANDOM);
+
+	db_header = h;
+	db_mapped = st.st_size;
+	return true;
+}
+
+void
+gamedb_close(void){
+	if (db_header)
+		munmap((void *)db_header, db_mapped);
+	db_header = NULL;
+	db_mapped = 0;
+}
+
+bool
+gamedb_ready(void){
+	return db_header != NULL;
+}
+
+/*
+	the moves played from the game's position that are legal in it
+	(a hash collision could bring up moves of some other position),
+	returns how many there are, at most "max"
+*/
+int
+gamedb_moves(GameCtx *gmctx, DbMoveStats *moves, int max){
+
+	if (db_header == NULL) return 0;
+
+	const DbEntry *entries = (const DbEntry *)(db_header + 1);
+	uint64_t key = gmctx->pos.hash, lo = 0, hi = db_header->count;
+
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (entries[mid].key < key) lo = mid + 1;
+		else hi = mid;
+	}
+
+	const LegalCache *legal = legal_moves(gmctx);
+	int n = 0;
+
+	for (uint64_t i = lo; i<db_header->count && entries[i].key == key && n < max; ++i) {
+		const DbEntry *e = &(entries[i]);
+		int index = movebuf_find(&(legal->moves), e->move, false);
+		if (index < 0) continue;
+		moves[n].move = legal->moves.moves[index];
+		moves[n].count = e->count;
+		moves[n].wins = e->wins;
+		moves[n].draws = e->draws;
+		moves[n].losses = e->losses;
+		n++;
+	}
+
+	return n;
+}
+
+/* the game's position's moves, the most played first */
+void
+gamedb_print(GameCtx *gmctx){
+
+	DbMoveStats moves[MAX_MOVES];
+	char notation[4 * (MAX_CAPTURES + 1)];
+	uint64_t total = 0;
+
+	if (db_header == NULL) {
+		printf("No game database open\n");
+		return;
+	}
+
+	int n = gamedb_moves(gmctx, moves, MAX_MOVES);
+	for (int i = 1; i<n; ++i)
+		for (int j = i; j>0 && moves[j].count > moves[j - 1].count; --j) {
+			DbMoveStats t = moves[j];
+			moves[j] = moves[j - 1];
+			moves[j - 1] = t;
+		}
+
+	for (int i = 0; i<n; ++i) total += moves[i].count;
+
+	if (n == 0) {
+		printf("Not in the game database\n");
+		return;
+	}
+
+	printf("move          games     win    draw    loss   score\n");
+	for (int i = 0; i<n; ++i) {
+		const DbMoveStats *m = &(moves[i]);
+		uint32_t decided = m->wins + m->draws + m->losses;
+		move_format_path(m->move, notation);
+		printf("%-12s %6u  %5.1f%%  %5.1f%%  %5.1f%%  %5.1f%%\n", notation, m->count,
+		       decided ? 100.0 * m->wins / decided : 0.0,
+		       decided ? 100.0 * m->draws / decided : 0.0,
+		       decided ? 100.0 * m->losses / decided : 0.0,
+		       decided ? 100.0 * (m->wins + m->draws / 2.0) / decided : 0.0);
+	}
+	printf("%llu games from here\n", (unsigned long long)total);
+}
+
+/* BUILDING */
+
+static int
+db_entry_compare(const void *a, const void *b){
+	const DbEntry *x = a, *y = b;
+	if (x->key != y->key) return x->key < y->key ? -1 : 1;
+	if (x->move != y->move) return x->move < y->move ? -1 : 1;
+	return 0;
+}
+
+static void
+db_entry_merge(DbEntry *into, const DbEntry *e){
+	into->count += e->count;
+	into->wins += e->wins;
+	into->draws += e->draws;
+	into->losses += e->losses;
+}
+
+/* a piece of an archive that starts with a game */
+typedef
+struct {
+	const char *data;
+	size_t len;
+} DbChunk;
+
+typedef
+struct {
+	const char *out;
+	DbChunk chunks[DB_MAX_CHUNKS];
+	int chunk_count;
+	atomic_int next;
+	size_t run_cap;		// entries in every thread's run
+} DbBuild;
+
+typedef
+struct {
+	DbBuild *build;
+	int id;
+	DbEntry *run;
+	size_t len;
+	int runs;
+	uint64_t games;
+	uint64_t illegal;
+	uint64_t plies;
+	bool failed;
+} DbWorker;
+
+static void
+db_run_path(const char *out, int worker, int run, char *path, size_t size){
+	snprintf(path, size, "%s.run%d.%d", out, worker, run);
+}
+
+/*
+	does a game start at "at": a tag at the start of a line, and the
+	line before it (that isn't empty) isn't a tag as well
+*/
+static bool
+db_game_starts(const char *data, size_t at){
+
+	if (data[at] != '[' || (at > 0 && data[at - 1] != '\n')) return false;
+
+	size_t c = at;
+	while (c > 0 && (data[c - 1] == ' ' || data[c - 1] == '\t' || data[c - 1] == '\r' || data[c - 1] == '\n'))
+		c--;
+	if (c == 0) return true;
+	while (c > 0 && data[c - 1] != '\n') c--;
+
+	return data[c] != '[';
+}
+
+/* cuts "data" into about "want" pieces (at most) where games start */
+static void
+db_split(DbBuild *b, const char *data, size_t len, int want){
+
+	size_t size = len / want > DB_MIN_CHUNK ? len / want : DB_MIN_CHUNK;
+	size_t start = 0;
+	int last = b->chunk_count + want - 1;
+
+	while (start < len) {
+		size_t end = start + size;
+		if (end >= len || b->chunk_count == last)
+			end = len;
+		else
+			while (end < len && !db_game_starts(data, end)) end++;
+
+		b->chunks[b->chunk_count++] = (DbChunk){ data + start, end - start };
+		start = end;
+	}
+}
+
+/* sorts the run, merges the same moves and writes it to a file */
+static bool
+db_flush(DbWorker *w){
+
+	char path[4096];
+	size_t len = 0;
+
+	if (w->len == 0) return true;
+	if (w->runs == DB_MAX_RUNS) return false;
+
+	qsort(w->run, w->len, sizeof(DbEntry), db_entry_compare);
+	for (size_t i = 0; i<w->len; ++i) {
+		if (len > 0 && db_entry_compare(&(w->run[len - 1]), &(w->run[i])) == 0)
+			db_entry_merge(&(w->run[len - 1]), &(w->run[i]));
+		else
+			w->run[len++] = w->run[i];
+	}
+
+	db_run_path(w->build->out, w->id, w->runs, path, sizeof path);
+	FILE *f = fopen(path, "wb");
+	bool ok = f != NULL && fwrite(w->run, sizeof(DbEntry), len, f) == len;
+	if (f && fclose(f) != 0) ok = false;
+
+	w->runs++;
+	w->len = 0;
+	return ok;
+}
+
+/* replays the pieces of the archives it gets, every position into the run */
+static void *
+db_worker(void *arg){
+
+	DbWorker *w = arg;
+	DbBuild *b = w->build;
+	PdnGame *game = malloc(sizeof(PdnGame));
+	int chunk;
+
+	stats_thread_start();
+	if (game == NULL) {
+		w->failed = true;
+		return NULL;
+	}
+
+	while (!w->failed && (chunk = atomic_fetch_add(&(b->next), 1)) < b->chunk_count) {
+
+		PdnReader reader = { b->chunks[chunk].data, b->chunks[chunk].len, 0, false };
+		int status;
+
+		while ((status = pdn_next(&reader, game)) != PDN_EOF) {
+			if (status == PDN_ILLEGAL) {
+				w->illegal++;
+				continue;
+			}
+
+			for (int i = 0; i<game->len; ++i) {
+				if (w->len == b->run_cap && !db_flush(w)) {
+					w->failed = true;
+					break;
+				}
+				COLOR mover = (i % 2 == 0) == (game->start.turn == BLACK) ? BLACK : WHITE;
+				DbEntry *e = &(w->run[w->len++]);
+				memset(e, 0, sizeof *e);
+				e->key = game->keys[i];
+				e->move = game->moves[i];
+				e->count = 1;
+				if (game->result == PDN_DRAW)
+					e->draws = 1;
+				else if (game->result == (mover == BLACK ? PDN_BLACK_WINS : PDN_WHITE_WINS))
+					e->wins = 1;
+				else if (game->result != PDN_UNKNOWN)
+					e->losses = 1;
+			}
+			w->games++;
+			w->plies += game->len;
+		}
+	}
+
+	if (!w->failed && !db_flush(w)) w->failed = true;
+
+	free(game);
+	return NULL;
+}
+
+/* the runs' next records, in a heap by the smallest */
+typedef
+struct {
+	DbEntry entry;
+	FILE *f;
+} DbRun;
+
+static void
+db_heap_down(DbRun **heap, int len, int i){
+	for (;;) {
+		int min = i, l = 2 * i + 1, r = l + 1;
+		if (l < len && db_entry_compare(&(heap[l]->entry), &(heap[min]->entry)) < 0) min = l;
+		if (r < len && db_entry_compare(&(heap[r]->entry), &(heap[min]->entry)) < 0) min = r;
+		if (min == i) return;
+		DbRun *t = heap[i];
+		heap[i] = heap[min];
+		heap[min] = t;
+		i = min;
+	}
+}
+
+/* merges all the runs into the database, removing them */
+static bool
+db_merge(DbBuild *b, DbWorker *workers, int threads, DbHeader *header){
+
+	char path[4096];
+	int total = 0, len = 0;
+	bool ok = true;
+
+	for (int i = 0; i<threads; ++i) total += workers[i].runs;
+
+	DbRun *runs = calloc(total ? total : 1, sizeof(DbRun));
+	DbRun **heap = calloc(total ? total : 1, sizeof(DbRun *));
+	FILE *out = fopen(b->out, "wb");
+
+	if (runs == NULL || heap == NULL || out == NULL) ok = false;
+	if (ok) ok = fwrite(header, sizeof *header, 1, out) == 1;
+
+	for (int i = 0, n = 0; i<threads; ++i)
+		for (int r = 0; r<workers[i].runs; ++r, ++n) {
+			db_run_path(b->out, i, r, path, sizeof path);
+			if (!ok) continue;
+			if ((runs[n].f = fopen(path, "rb")) == NULL) {
+				ok = false;
+				continue;
+			}
+			setvbuf(runs[n].f, NULL, _IOFBF, DB_RUN_BUFFER);
+			if (fread(&(runs[n].entry), sizeof(DbEntry), 1, runs[n].f) == 1)
+				heap[len++] = &(runs[n]);
+		}
+
+	for (int i = len / 2 - 1; i>=0; --i)
+		db_heap_down(heap, len, i);
+
+	DbEntry current;
+	bool have = false;
+
+	while (ok && len > 0) {
+		DbRun *top = heap[0];
+
+		if (have && db_entry_compare(&current, &(top->entry)) == 0)
+			db_entry_merge(&current, &(top->entry));
+		else {
+			if (have) {
+				ok = fwrite(&current, sizeof current, 1, out) == 1;
+				header->count++;
+			}
+			current = top->entry;
+			have = true;
+		}
+
+		if (fread(&(top->entry), sizeof(DbEntry), 1, top->f) != 1)
+			heap[0] = heap[--len];
+		db_heap_down(heap, len, 0);
+	}
+	if (ok && have) {
+		ok = fwrite(&current, sizeof current, 1, out) == 1;
+		header->count++;
+	}
+
+	// the header again, now that the count is known
+	if (ok) ok = fseek(out, 0, SEEK_SET) == 0 && fwrite(header, sizeof *header, 1, out) == 1;
+	if (out && fclose(out) != 0) ok = false;
+
+	for (int i = 0, n = 0; i<threads; ++i)
+		for (int r = 0; r<workers[i].runs; ++r, ++n) {
+			if (runs && runs[n].f) fclose(runs[n].f);
+			db_run_path(b->out, i, r, path, sizeof path);
+			unlink(path);
+		}
+
+	free(runs);
+	free(heap);
+	return ok;
+}
+
+/*
+	builds the database "out" from the PDN archives on "threads"
+	threads, with about "mb" MB for the runs
+*/
+bool
+gamedb_build(const char *out, char *inputs[], int input_count, int threads, size_t mb){
+
+	pthread_t handles[MAX_THREADS];
+	DbWorker workers[MAX_THREADS];
+	PdnReader readers[DB_MAX_INPUTS];
+	DbHeader header;
+	bool ok = true;
+
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+	if (input_count > DB_MAX_INPUTS) {
+		printf("At most %d archives at a time\n", DB_MAX_INPUTS);
+		return false;
+	}
+
+	DbBuild *b = calloc(1, sizeof(DbBuild));
+	if (b == NULL) return false;
+	b->out = out;
+	b->run_cap = mb * 1024 * 1024 / threads / sizeof(DbEntry);
+	if (b->run_cap < 1024) b->run_cap = 1024;
+	atomic_init(&(b->next), 0);
+
+	zobrist_init();
+
+	int opened = 0;
+	for (int i = 0; i<input_count; ++i, ++opened) {
+		if (!pdn_open(&(readers[i]), inputs[i])) {
+			printf("Couldn't open %s\n", inputs[i]);
+			ok = false;
+			break;
+		}
+		if (readers[i].len > 0)
+			db_split(b, readers[i].data, readers[i].len, threads * DB_CHUNKS_PER_THREAD);
+	}
+
+	double start = clock_seconds();
+	int started = 0;
+
+	memset(workers, 0, sizeof workers);
+	for (int i = 0; ok && i<threads; ++i) {
+		workers[i].build = b;
+		workers[i].id = i;
+		if ((workers[i].run = malloc(b->run_cap * sizeof(DbEntry))) == NULL) ok = false;
+	}
+
+	if (ok) {
+		started = 1;
+		for (int i = 1; i<threads; ++i, ++started)
+			if (pthread_create(&(handles[i]), NULL, db_worker, &(workers[i])) != 0)
+				break;
+		db_worker(&(workers[0]));
+		for (int i = 1; i<started; ++i)
+			pthread_join(handles[i], NULL);
+	}
+
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, DB_MAGIC, 4);
+	header.version = DB_VERSION;
+
+	uint64_t illegal = 0;
+	int runs = 0;
+	for (int i = 0; i<started; ++i) {
+		if (workers[i].failed) ok = false;
+		header.games += workers[i].games;
+		header.plies += workers[i].plies;
+		illegal += workers[i].illegal;
+		runs += workers[i].runs;
+	}
+	double replayed = clock_seconds();
+
+	if (ok)
+		ok = db_merge(b, workers, started, &header);
+	else
+		for (int i = 0; i<started; ++i)
+			for (int r = 0; r<workers[i].runs; ++r) {
+				char path[4096];
+				db_run_path(out, i, r, path, sizeof path);
+				unlink(path);
+			}
+
+	double elapsed = clock_seconds() - start;
+
+	printf("%llu games (%llu illegal), %llu plies, %d runs, %llu entries written to %s\n",
+	       (unsigned long long)header.games, (unsigned long long)illegal,
+	       (unsigned long long)header.plies, runs, (unsigned long long)header.count, out);
+	printf("replayed in %.3f s on %d threads, merged in %.3f s, %.0f games/s\n",
+	       replayed - start, started, elapsed - (replayed - start),
+	       elapsed > 0 ? header.games / elapsed : 0.0);
+
+	for (int i = 0; i<threads; ++i) free(workers[i].run);
+	for (int i = 0; i<opened; ++i) pdn_close(&(readers[i]));
+	free(b);
+	return ok;
+}
+
+/*
+	checkers db build <out> <archives>... [-j threads] [-m MB]
+	checkers db query <database> [FEN]
+*/
+int
+gamedb_main(int argc, char *argv[]){
+
+	if (argc >= 4 && strcmp(argv[1], "build") == 0) {
+		int threads = 1;
+		size_t mb = DB_DEFAULT_MB;
+		char *inputs[DB_MAX_INPUTS];
+		int n = 0;
+
+		for (int i = 3; i<argc; ++i) {
+			if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)      threads = atoi(argv[++i]);
+			else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) mb = strtoul(argv[++i], NULL, 10);
+			else if (n < DB_MAX_INPUTS)                           inputs[n++] = argv[i];
+			else {
+				printf("At most %d archives at a time\n", DB_MAX_INPUTS);
+				return 1;
+			}
+		}
+
+		return gamedb_build(argv[2], inputs, n, threads, mb) ? 0 : 1;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "query") == 0) {
+		GameCtx ctx;
+		DbMoveStats moves[MAX_MOVES];
+
+		memset(&ctx, 0, sizeof ctx);
+		zobrist_init();
+		setup_board(&(ctx.pos));
+		if (argc >= 4 && !position_from_fen(&(ctx.pos), argv[3])) {
+			printf("Invalid FEN: %s\n", argv[3]);
+			return 1;
+		}
+		if (!gamedb_open(argv[2])) {
+			printf("Couldn't open the game database %s\n", argv[2]);
+			return 1;
+		}
+
+		// time the lookup over a lot of runs, one is too quick to measure
+		double start = clock_seconds();
+		for (int i = 0; i<10000; ++i)
+			gamedb_moves(&ctx, moves, MAX_MOVES);
+		double elapsed = (clock_seconds() - start) / 10000;
+
+		gamedb_print(&ctx);
+		printf("lookup took %.2f us (%llu games in the database)\n", elapsed * 1e6,
+		       (unsigned long long)db_header->games);
+
+		gamedb_close();
+		return 0;
+	}
+
+	printf("usage: checkers db build <out> <archives>... [-j threads] [-m MB]\n"
+	       "       checkers db query <database> [FEN]\n");
+	return 1;
+}
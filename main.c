@@ -1,93 +1,11 @@
 // Note to self:
 // create a program using sokol (bit of a gui) that we can use to edit checkersboards
-// modify MoveList : give it **head**
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <string.h>
-#include <stdbool.h>
+#include <pthread.h>
 #include <time.h>
+#include <unistd.h>
 
-/* ASCII */
-#define ISDIGIT(x)	('1' <= x && x <= '8')
-#define ISALPHA(x)	( ('a' <= x && x <= 'h') || ('A' <= x && x <= 'H') )
-#define ISUPPERCASE(x)  ( x >= 'A' && x <= 'Z' )
-
-/* GAME MACROS */
-
-#ifdef _WIN32
-	#define RANDINT(MAX) rand() % MAX + 1
-#else
-#ifdef __linux__
-	#define RANDINT(MAX) rand() % MAX + 1
-#endif
-#endif
-
-/*
-	returns the index of the square opposite to the one
-	given in the "square" argument
-	the "d" argument is used to determine which direction we
-	want to find the opposing square
-*/
-#define OPPOSING_SQUARE(S, D) ADJ_SQUARES[ (ADJ_SQUARES[S-1][D] - 1) ][D]
-
-/* copies a 4 "item" array into another */
-#define FOURBYTECOPY(FROM, TO) do { for (int i = 0; i<4; ++i) { TO[i] = FROM[i]; } } while (false);
-
-/* GAME CONSTANTS */
-
-/*
-	__1-__2-__3-__4-
-	5-__6-__7-__8-__
-	__9-__10__11__12
-	13__14__15__16__
-	__17__18__19__20
-	21__22__23__24__
-	__25__26__27__28
-	29__30__31__32__
-*/
-
-/*
-	a 4 byte array with the squares adjacent to the square "index"+1
-	in NW NE SW SE order.
-	if there is no square to be found in a direction, it is set to 0
-*/
-const uint8_t ADJ_SQUARES[32][4] = {
-		{ 0, 0, 5, 6 },     // 1
-		{ 0, 0, 6, 7 },     // 2
-		{ 0, 0, 7, 8 },     // 3
-		{ 0, 0, 8, 0 },     // 4
-		{ 0, 1, 0, 9 },     // 5
-		{ 1, 2, 9, 10 },    // 6
-		{ 2, 3, 10, 11 },   // 7
-		{ 3, 4, 11, 12 },   // 8
-		{ 5, 6, 13, 14 },   // 9
-		{ 6, 7, 14, 15 },   // 10
-		{ 7, 8, 15, 16 },   // 11
-		{ 8, 0, 16, 0 },    // 12
-		{ 0, 9, 0, 17 },    // 13
-		{ 9, 10, 17, 18 },  // 14
-		{ 10, 11, 18, 19 }, // 15
-		{ 11, 12, 19, 20 }, // 16
-		{ 13, 14, 21, 22 }, // 17
-		{ 14, 15, 22, 23 }, // 18
-		{ 15, 16, 23, 24 }, // 19
-		{ 16, 0, 24, 0 },   // 20
-		{ 0, 17, 0, 25 },   // 21
-		{ 17, 18, 25, 26 }, // 22
-		{ 18, 19, 26, 27 }, // 23
-		{ 19, 20, 27, 28 }, // 24
-		{ 21, 22, 29, 30 }, // 25
-		{ 22, 23, 30, 31 }, // 26
-		{ 23, 24, 31, 32 }, // 27
-		{ 24, 0, 32, 0 },   // 28
-		{ 0, 25, 0, 0 },    // 29
-		{ 25, 26, 0, 0 },   // 30
-		{ 26, 27, 0, 0 },   // 31
-		{ 27, 28, 0, 0 }    // 32
-};
-
+#include "checkers.h"
 
 /* ANSI ESCAPE CODES */
 #define ANSI_HIGHLIGHT "\033[7m"
@@ -95,286 +13,116 @@ const uint8_t ADJ_SQUARES[32][4] = {
 #define ANSI_RED	   "\033[30;41m"
 #define ANSI_YELLOW    "\033[30;103m"
 
-/* used to determine the next square when jumping */
-typedef
-enum {
-	NW,
-	NE,
-	SW,
-	SE,
-} DIRECTION;
-
-/* MOVELIST */
-#define MOVELIST_MALLOC ((MoveList *) malloc(sizeof(MoveList)))
-
-/* Cool Struct For Moves */
-typedef
-struct {
-	uint8_t from;
-	uint8_t to;
-	uint8_t taken[16];
-	uint8_t taken_len;
-	DIRECTION direction;
-} Move;
-
-
 /*
-	Compares two Move structs for equality
-	the "ignore_taken" boolean can be provided to the function for it
-	to ignore the ".taken" attribute of both structs
-	(meaning it'll only compare the "from" and the "to" attributes)
-*/
-bool
-move_equal(Move m1, Move m2, bool ignore_taken){
-	if (!ignore_taken){
-		if (m1.taken_len != m2.taken_len)
-			return false;
-		for (int i = 0; i<m1.taken_len; ++i)
-			if (m1.taken[i] != m2.taken[i])
-				return false;
-	}
-	if (m1.from != m2.from || m1.to != m2.to)
-		return false;
-	return true;
-}
-
-/* Copies one Move into the other */
-void
-move_copy(Move m_from, Move *m_to){
-	m_to->from = m_from.from;
-	m_to->to   = m_from.to;
-	m_to->taken_len = m_from.taken_len;
-	for (int i = 0; i<m_from.taken_len; ++i)
-		(m_to->taken)[i] = (m_from.taken)[i];
-}
-
-/* Computer Science Moment: Storing the Moves in a Linked List */
-typedef
-struct movelist {
-	Move value;
-	struct movelist *next;
-} MoveList;
-
-/* storing all the relevant game data in one struct */
-typedef
-struct {
-	char board[32];
-	bool player;
-	char last_turn;
-	MoveList *movelist;
-	MoveList *available_moves;
-	int movelist_len;
-	int available_moves_len;
-	bool quit;
-	uint8_t selected_piece;
-} GameCtx;
+	the board is drawn into a Frame first, and the Frame is turned into text
+	in one buffer that goes out with a single write
 
-/*
-	utility functions for the linked list
+	on a terminal the board stays at the top of the screen (the rest scrolls
+	underneath it) and only the squares that changed since the last frame
+	are redrawn, with cursor addressing
+	anywhere else (a pipe or a file) the whole board is written every time
 */
-// add an element to the end of the list
-void
-movelist_append(MoveList **mvlstptr, Move m, int *length){
-	if (*mvlstptr == NULL) {
-		(*mvlstptr) = MOVELIST_MALLOC;
-		(*mvlstptr)->value = m;
-		for (int i = 0; i<m.taken_len; ++i)
-			((*mvlstptr)->value).taken[i] = m.taken[i];
-		(*mvlstptr)->next  = NULL;
-	}
-	else {
-		MoveList *ptr = (*mvlstptr);
-		while ( ptr->next != NULL )
-			ptr = ptr->next;
-		ptr->next = MOVELIST_MALLOC;
-		ptr->next->value = m;
-		for (int i = 0; i<m.taken_len; ++i)
-			ptr->next->value.taken[i] = m.taken[i];
-		ptr->next->next  = NULL;
-	}
-	*length += 1;
-}
 
-// pop an element off the end of the list
-Move
-movelist_pop(MoveList **mvlstptr, bool *success) {
+// what a square looks like
+enum { CELL_LIGHT, CELL_DARK, CELL_TARGET, CELL_TAKEN };
 
-	Move m;
+static const char *CELL_START[] = { ANSI_HIGHLIGHT, "", ANSI_YELLOW, ANSI_RED };
+static const char *CELL_END[]   = { ANSI_CLEAR, "", ANSI_CLEAR, ANSI_CLEAR };
 
-	if (mvlstptr == NULL) {
-		*success = false;
-		return m;
-	}
+// the screen row of the board's top row, and the first row of the text under it
+#define BOARD_TOP  1
+#define SCROLL_TOP 11
 
-	MoveList *prev = *mvlstptr;
-	MoveList *iter = *mvlstptr;
-
-	while (iter->next != NULL) {
-		prev = iter;
-		iter = iter->next;
+typedef
+struct {
+	char glyph[8][8];
+	uint8_t style[8][8];
+} Frame;
+
+static Frame last_frame;
+static bool frame_on_screen = false;
+static int terminal = -1;	// not checked yet
+
+/* "targets" are painted yellow and "taken" red */
+static void
+frame_build(Frame *f, const Position *pos, Bitboard targets, Bitboard taken){
+
+	memset(f->glyph, ' ', sizeof f->glyph);
+	memset(f->style, CELL_LIGHT, sizeof f->style);
+
+	for (uint8_t sq = 1; sq<=32; ++sq) {
+		char col;
+		uint8_t row;
+		square_to_coord(sq, &col, &row);
+
+		int r = 8 - row, c = col - 'a';
+		f->glyph[r][c] = piece_at(pos, sq);
+		f->style[r][c] = (targets & SQ_BIT(sq)) ? CELL_TARGET :
+		                 (taken & SQ_BIT(sq))   ? CELL_TAKEN  : CELL_DARK;
 	}
-
-	m = iter->value;
-	free(iter);
-
-	// the list was only one element long
-	if (iter == prev) *mvlstptr = NULL;
-
-	else prev->next = NULL; 
-
-	*success = true;
-
-	return m;
-
-}
-
-MoveList *
-movelist_last(MoveList **mvlstptr) {
-
-	MoveList *iter = *mvlstptr;
-
-	while (iter->next != NULL)
-		iter = iter->next;
-	
-	return iter;
 }
 
-// free all the memory acquired by the list
-void
-movelist_free(MoveList **mvlstptr, int *length){
-
-	if ( (*mvlstptr) == NULL ) return;
-
-	MoveList *prev = (*mvlstptr);
-
-	do {
-		(*mvlstptr) = (*mvlstptr)->next;
-		free(prev);
-		prev = (*mvlstptr);
-	} while ( (*mvlstptr) != NULL );
-
-	*length = 0;
-	*mvlstptr = NULL;
-
+static int
+frame_cell(char *out, const Frame *f, int r, int c){
+	uint8_t style = f->style[r][c];
+	return sprintf(out, "%s%c%s", CELL_START[style], f->glyph[r][c], CELL_END[style]);
 }
 
-// returns the length of the list
-int
-movelist_length(MoveList *mvlstptr){
+static void
+frame_draw(const Frame *f){
 
+	char out[4096];
 	int len = 0;
 
-	MoveList *tmp = mvlstptr;
-	while ( tmp != NULL) {
-		len++;
-		tmp = tmp->next;
+	if (terminal < 0) {
+		const char *term = getenv("TERM");
+		terminal = isatty(STDOUT_FILENO) && term && strcmp(term, "dumb") != 0;
 	}
 
-	return len;
-	
-}
-
-// returns the Move from the list at position "index" (0 indexed)
-Move
-movelist_get(MoveList *mvlstptr, int index){
-	MoveList *tmp = mvlstptr;
-	for (int i = 0; i<index && tmp->next != NULL; ++i)
-		tmp = tmp->next;
-	return tmp->value;
-}
-
-/*
- 	the "ignore_taken" argument in this function call will be provided to
-	the "move_equal" function inside of it
- */
-bool
-movelist_contains(MoveList *mvlstptr, Move m, bool ignore_taken){
-	MoveList *tmp = mvlstptr;
-	while (tmp != NULL){
-		if (move_equal(tmp->value, m, ignore_taken))
-			return true;
-		tmp = tmp->next;
+	if (!terminal) {
+		for (int r = 0; r<8; ++r) {
+			out[len++] = '0' + (8 - r);
+			for (int c = 0; c<8; ++c)
+				len += frame_cell(out + len, f, r, c);
+			out[len++] = '\n';
+		}
+		len += sprintf(out + len, " abcdefgh\n");
 	}
-	return false;
-}
-
-/* 
-   writes into an array of booleans of length 4.
-   (NW, NE, SW, SE)
-   true means the piece is allowed to move in that direction
-*/
-void
-direction_filter(GameCtx *gmctx, uint8_t square, bool filter[4]){
-	char piece = (gmctx->board)[square-1];
-	
-	if (ISUPPERCASE(piece))
-		for (int i = 0; i<4; ++i) filter[i]= true;
-	else if (piece == 'b'){
-		filter[0] = false;
-		filter[1] = false;
-		filter[2] = true;
-		filter[3] = true;
+	else if (!frame_on_screen) {
+		// a clean screen, with the text scrolling only below the board
+		len += sprintf(out + len, "\033[2J\033[%d;r", SCROLL_TOP);
+		for (int r = 0; r<8; ++r) {
+			len += sprintf(out + len, "\033[%d;1H%c", BOARD_TOP + r, '0' + (8 - r));
+			for (int c = 0; c<8; ++c)
+				len += frame_cell(out + len, f, r, c);
+		}
+		len += sprintf(out + len, "\033[%d;1H abcdefgh\033[%d;1H", BOARD_TOP + 8, SCROLL_TOP);
+		frame_on_screen = true;
 	}
 	else {
-		filter[0] = true;
-		filter[1] = true;
-		filter[2] = false;
-		filter[3] = false;
-	}
-}
-
-/*
-	turns the index of the square to coordinate values
-*/
-void
-square_to_coord(uint8_t square, char *col, uint8_t *row){
-
-	int i = 0, j = 0, k = 1;
-	bool l = true;
-
-	for (i = 0; i<8; ++i){
-	for (j = 0; j<8; ++j){
-
-		if (!l) {
-			if (k == square){
-				*row = 8-i;
-				*col = 'a' + j;
-				return;
+		// save the cursor, redraw what changed, and go back
+		len += sprintf(out + len, "\0337");
+		for (int r = 0; r<8; ++r)
+			for (int c = 0; c<8; ++c) {
+				if (f->glyph[r][c] == last_frame.glyph[r][c] && f->style[r][c] == last_frame.style[r][c])
+					continue;
+				len += sprintf(out + len, "\033[%d;%dH", BOARD_TOP + r, 2 + c);
+				len += frame_cell(out + len, f, r, c);
 			}
-			k++;
-		}
-
-		l = !l;
+		len += sprintf(out + len, "\0338");
 	}
 
-	if ( !(j%2) )
-		l = !l;
-	}
+	last_frame = *f;
+	fwrite(out, 1, len, stdout);
+	fflush(stdout);
 }
 
-/*
-	turns a pair of coordinates to the index of the square
-*/
-uint8_t
-coord_to_square(char col, uint8_t row){
-
-	int i = 0, j = 0, k = 1;
-	bool l = true;
-
-	for (i = 0; i<8; ++i){
-	for (j = 0; j<8; ++j){
-
-		if (col == 'a' + j && row == 8-i)
-			return k;
-
-		if (!l) k++;
-
-		l = !l;
-	}
-
-	if ( !(j%2) ) l = !l;
-
-	}
+/* gives the terminal its whole screen back */
+static void
+frame_close(void){
+	if (frame_on_screen)
+		printf("\033[r\033[999;1H\n");
+	frame_on_screen = false;
 }
 
 /*
@@ -383,77 +131,36 @@ coord_to_square(char col, uint8_t row){
 	represent the colors of the squares
 */
 void
-print_board(char board[32]){
-	int i = 0, j = 0, k = 0;
-	bool l = true;
-	for (i = 0; i<8; ++i){
-		putc('0' + (8-i), stdout);
-		for (j = 0; j<8; ++j){
-			
-			if (l) printf(ANSI_HIGHLIGHT " " ANSI_CLEAR);
-			else putc(board[k++], stdout);
-
-			l = !l;
-		}
-
-		if ( !(j%2) )
-			l = !l;
-
-		putc('\n', stdout);
-	}
-	printf(" abcdefgh\n");
+print_board(const Position *pos){
+	Frame f;
+	double start = clock_seconds();
+	frame_build(&f, pos, 0, 0);
+	frame_draw(&f);
+	STAT_TIME(STAT_TIME_RENDER, start);
 }
 
 /*
 	prints the current state of the board, and
 	also highlights the squares (with a pretty yellow color) that the currently selected
 	piece (given by the "square" argument) can move to
+	and the pieces its moves take (in red)
 */
 void
-print_board_with_moves(char board[32], uint8_t square, MoveList *mvlstptr){
-
-	Move m;
-	m.from = square;
-	int i = 0, j = 0, k = 0;
-	bool l = true;
-	for (i = 0; i<8; ++i){
-		putc('0' + (8-i), stdout);
-		for (j = 0; j<8; ++j){
-			
-			if (l) printf(ANSI_HIGHLIGHT " " ANSI_CLEAR);
-			else {
-				m.to = coord_to_square('a' + j, 8-i);
-				if (movelist_contains(mvlstptr, m, true))
-					printf(ANSI_YELLOW);
-				else {
-					MoveList *current = mvlstptr;
-					bool flag = false;
-					while (current != NULL && !flag) {
-
-					for ( int t = 0; t<current->value.taken_len; ++t ) {
-						if (current->value.taken[t] == m.to) {
-							printf(ANSI_RED);
-							flag = true;
-							break;
-						}
-					}
-					current = current->next;
-					
-					}
-				}
-				putc(board[k++], stdout);
-				printf(ANSI_CLEAR);
-			}
+print_board_with_moves(const Position *pos, uint8_t square, const MoveBuf *buf){
 
-			l = !l;
-		}
-
-		if ( !(j%2) )
-			l = !l;
+	Bitboard targets = 0, taken = 0;
+	Frame f;
 
-		putc('\n', stdout);
+	for (int n = 0; n<buf->len; ++n) {
+		if (MOVE_FROM(buf->moves[n]) == square)
+			targets |= SQ_BIT(MOVE_TO(buf->moves[n]));
+		taken |= MOVE_TAKEN(buf->moves[n]);
 	}
-	printf(" abcdefgh\n");
+
+	double start = clock_seconds();
+	frame_build(&f, pos, targets, taken);
+	frame_draw(&f);
+	STAT_TIME(STAT_TIME_RENDER, start);
 }
 
 /*
@@ -463,191 +170,42 @@ void
 move_print(Move m) {
 	char from_col;
 	uint8_t from_row;
-	square_to_coord(m.from, &from_col, &from_row);
+	square_to_coord(MOVE_FROM(m), &from_col, &from_row);
 	char to_col;
 	uint8_t to_row;
-	square_to_coord(m.to, &to_col, &to_row);
+	square_to_coord(MOVE_TO(m), &to_col, &to_row);
 	printf("%c%d-%c%d", from_col, from_row, to_col, to_row);
 }
 
+/* the moves of the game with the current one in brackets, then its variations */
 void
-movelist_print(MoveList *mvlstptr) {
-	MoveList *ptr = mvlstptr;
-	while (ptr != NULL){
-		move_print(ptr->value);
-		printf("; ");
-		ptr = ptr->next;
+history_print(const History *h) {
+	for (int i = 1; i<h->len; ++i){
+		if (i % 2) printf("%d. ", (i + 1) / 2);
+		if (i == h->cur) putc('[', stdout);
+		move_print(h->plies[i].move);
+		printf(i == h->cur ? "] " : " ");
 	}
 	putc('\n', stdout);
-}
-
-void
-available_moves(GameCtx *gmctx, uint8_t square, bool jumping, bool must_take){
-
-	uint8_t adj_squares[4];
-	bool dir_filter[4];
-
-	FOURBYTECOPY(ADJ_SQUARES[square-1], adj_squares);
-
-	if (jumping)
-		// when jumping, the value of square is irrelevant
-		// we should rather get the last jump's "from" field
-		direction_filter(gmctx, movelist_last(&(gmctx->available_moves))->value.from, dir_filter);
-	else
-		direction_filter(gmctx, square, dir_filter);
-
-
-	for (int i = 0; i<4; ++i){
-
-		uint8_t neighbor = adj_squares[i];
-
-		// not allowed to go that way
-		if (!(dir_filter[i])) continue;
-
-		if (jumping && neighbor == 0) {
-			// reached end
-			MoveList* lst_mv = movelist_last(&(gmctx->available_moves));
-			lst_mv->value.to = square;
-			if (i == 3)
-				return;
-		}
-
-		else if (!jumping && (gmctx->board)[neighbor-1] == ' '){
-
-			if (must_take) continue;
-
-			// just add a simple move
-			Move m;
-			m.taken_len = 0;
-			m.from = square;
-			m.to = neighbor;
-			m.direction = i;
-			movelist_append( &(gmctx->available_moves), m, &(gmctx->available_moves_len));
-		}
-
-		else if (jumping && ( (gmctx->board)[neighbor-1] == ' '
-						   || (gmctx->board)[neighbor-1] == (gmctx->board)[square-1] ) ) {
-			// cannot jump anymore
-			MoveList* lst_mv = movelist_last(&(gmctx->available_moves));
-			lst_mv->value.to = square;
-			if (i == 3)
-				return;
-		}
-
-		else if ((gmctx->board)[neighbor-1] != (gmctx->board)[square-1]){
-
-			uint8_t opp_sqr = OPPOSING_SQUARE(square, i);
-
-			if ((gmctx->board)[opp_sqr-1] == ' '){
-
-				// everything is set for a good jump
-
-				if (!jumping) {
-					// create new move object the first time
-					Move m;
-					m.taken_len = 0;
-					m.from = square;
-					m.direction = i;
-					m.taken[m.taken_len++] = neighbor;
-					movelist_append( &(gmctx->available_moves), m, &(gmctx->available_moves_len));
-				}
-
-				else {
-					// every next call we just add to the list of taken pieces
-					MoveList* lst_mv = movelist_last(&(gmctx->available_moves));
-					lst_mv->value.taken[lst_mv->value.taken_len++] = neighbor;
-				}
-
-				available_moves(gmctx, opp_sqr, true, must_take);
-
-				if (jumping)
-					// otherwise we still need to check other directions
-					return;
-			}
-
-			else if (jumping) {
-				// we couldn't finish the jump
-				MoveList* lst_mv = movelist_last(&(gmctx->available_moves));
-				lst_mv->value.to = square;
-				if (i == 3)
-					return;
-			} 
-		}
-	}
-}
-
-// checks all pieces of "color" and checks if
-// there are any moves that result in taking with
-// setting the must_take argument of available_moves true
-bool
-taking_available(GameCtx *ctx, char color) {
-
-	for ( uint8_t i = 0; i<32; ++i) {
-		if ( ( ctx->board[i] | 32 ) == color ) {
-
-			movelist_free(&(ctx->available_moves), &(ctx->available_moves_len));
-			available_moves(ctx, i+1, false, true);
-
-			if (ctx->available_moves_len > 0) return true;
+	for (int v = 0; v<h->vars_len; ++v){
+		printf("variation %d after ply %d: ", v, h->vars[v].ply);
+		for (int i = 0; i<h->vars[v].len; ++i){
+			move_print(h->vars[v].plies[i].move);
+			putc(' ', stdout);
 		}
+		putc('\n', stdout);
 	}
-	
-	return false;
-}
-
-// if there is no piece, returns false
-// otherwise computes the available moves and stores them in the context
-bool
-select_piece(GameCtx *gmctx, uint8_t square) {
-
-	char color = (gmctx->board)[square-1];
-
-	if ( color == ' ' ) return false;
-
-	gmctx->selected_piece = square;
-	bool has_to_take = taking_available(gmctx, color|32);
-	available_moves(gmctx, square, false, has_to_take);
-
-	return true;
-}
-
-// this saves the move
-// then executes it (if it's correct)
-bool
-do_move(GameCtx *gmctx, Move m){
-
-	if ( !select_piece(gmctx, m.from)    ||
-		 gmctx->selected_piece != m.from ||
-		 !movelist_contains(gmctx->available_moves, m, true) )
-		return false;
-
-	movelist_append(&(gmctx->movelist), m, &(gmctx->movelist_len));
-
-	(gmctx->board)[m.to - 1] = (gmctx->board)[m.from - 1];
-	(gmctx->board)[m.from - 1] = ' ';
-
-	for (int i = 0; i<m.taken_len; ++i)
-		(gmctx->board)[m.taken[i] - 1] = ' ';
-
-	return true;
 }
 
-/*
-	set the board up for a new game
-*/
 void
-setup_board(char board[32]){
-	int i;
-	for (i = 0; i<12; ++i)
-		board[i] = 'b';
-	for (i = 12; i<20; ++i)
-		board[i] = ' ';
-	for (i = 20; i<32; ++i)
-		board[i] = 'w';
+movebuf_print(const MoveBuf *buf) {
+	for (int i = 0; i<buf->len; ++i){
+		move_print(buf->moves[i]);
+		printf("; ");
+	}
 	putc('\n', stdout);
 }
 
-
 /*
 	parsing the commands
 	the syntax of a command is as follows:
@@ -669,26 +227,100 @@ setup_board(char board[32]){
 
 	- sN[N] or saN
 	
+	'pN[N]' counts the positions N moves deep from the current one (perft)
+	and prints the count for every move
+
+	'stats' prints the engine statistics (see stats.c)
+
+	'db' prints what the games in the game database (-b, see gamedb.c)
+	played from the position and how they went
+
+	going through the game (see the History in checkers.h), after which
+	it's the human's turn, whichever side that is:
+	'undo' and 'redo' take back a move and play it again, 'go N' goes
+	to ply N (0 is the start), 'hist' prints the game and its variations
+	and 'var N' plays variation N instead of the moves it replaced
+
 	and 'q' quits
 */
+static void ponder_stop(const Move *played);
+
 Move
 parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 	
-	Move move;
-	move.taken_len = 0;
+	Move move = MOVE_NONE;
 
 	if (cmd[0] == 'q') {
 		printf("Quitting\n");
-		movelist_free(&(gmctx->movelist), &(gmctx->movelist_len));
 		gmctx->quit = true;
-		move.from = 0;
+		move = MOVE_NONE;
+		return move;
+	}
+
+	if (strcmp(cmd, "stats") == 0) {
+		stats_print(stdout);
+		*error = false;
+		move = MOVE_NONE;
+		return move;
+	}
+
+	if (strcmp(cmd, "db") == 0) {
+		gamedb_print(gmctx);
+		*error = false;
+		move = MOVE_NONE;
+		return move;
+	}
+
+	if (strcmp(cmd, "hist") == 0) {
+		history_print(&(gmctx->history));
+		*error = false;
+		move = MOVE_NONE;
+		return move;
+	}
+
+	if (strcmp(cmd, "undo") == 0 || strcmp(cmd, "redo") == 0 ||
+	    strncmp(cmd, "go ", 3) == 0 || strncmp(cmd, "var ", 4) == 0) {
+
+		History *h = &(gmctx->history);
+		bool done;
+
+		// the engine was thinking about the position that's left
+		ponder_stop(NULL);
+
+		if (cmd[0] == 'u')      done = history_goto(gmctx, h->cur - 1);
+		else if (cmd[0] == 'r') done = history_goto(gmctx, h->cur + 1);
+		else if (cmd[0] == 'g') done = history_goto(gmctx, atoi(cmd + 3));
+		else                    done = history_variation(gmctx, atoi(cmd + 4));
+
+		if (done)
+			printf("Ply %d of %d\n", h->cur, h->len - 1);
+		else
+			printf("There is no such %s!\n", cmd[0] == 'v' ? "variation (from this line)" : "ply");
+		*error = false;
+		move = MOVE_NONE;
+		return move;
+	}
+
+	if (cmd[0] == 'p') {
+		int depth = atoi(cmd + 1);
+		if (depth < 1) {
+			printf("Error parsing 'perft' command!\n");
+		}
+		else {
+			double start = clock_seconds();
+			uint64_t nodes = perft_divide(&(gmctx->pos), depth);
+			double elapsed = clock_seconds() - start;
+			printf("perft(%d) = %llu (%.0f nodes/s)\n", depth, (unsigned long long)nodes,
+			       elapsed > 0 ? nodes / elapsed : 0.0);
+		}
+		*error = false;
+		move = MOVE_NONE;
 		return move;
 	}
 
 	if (cmd[0] == 's'){
 		if (ISALPHA(cmd[1]) && ISDIGIT(cmd[2])){
 
-			char buffer[3];
 			uint8_t square = coord_to_square(cmd[1], cmd[2]-'0');
 
 			if (!select_piece(gmctx, square))
@@ -697,8 +329,8 @@ parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 			else {
 
 				printf("The available moves for the piece on square %d are: ", square);
-				movelist_print( gmctx->available_moves );
-				print_board_with_moves( gmctx->board, square, gmctx->available_moves );
+				movebuf_print( &(gmctx->available_moves) );
+				print_board_with_moves( &(gmctx->pos), square, &(gmctx->available_moves) );
 
 			}
 			
@@ -718,8 +350,8 @@ parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 				else {
 
 					printf("The available moves for the piece on square %d are: ", square);
-					movelist_print( gmctx->available_moves );
-					print_board_with_moves( gmctx->board, square, gmctx->available_moves );
+					movebuf_print( &(gmctx->available_moves) );
+					print_board_with_moves( &(gmctx->pos), square, &(gmctx->available_moves) );
 
 				}
 			}
@@ -729,7 +361,7 @@ parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 			*error = true;
 		}
 		*error = false;
-		move.from = 0;
+		move = MOVE_NONE;
 		return move;
 	}
 
@@ -780,8 +412,7 @@ parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 			return move;
 		}
 
-		move.from = from;
-		move.to   = to;
+		move = MOVE_PACK(from, to, 0, false);
 
 		*error = false;
 
@@ -861,8 +492,7 @@ parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 
 		to_row = atoi_buffer;
 
-		move.from = coord_to_square(from_col, from_row);
-		move.to = coord_to_square(to_col, to_row);
+		move = MOVE_PACK(coord_to_square(from_col, from_row), coord_to_square(to_col, to_row), 0, false);
 
 		return move;
 		
@@ -870,99 +500,294 @@ parse_cmd(GameCtx *gmctx, char cmd[6], bool *error) {
 
 }
 
-// AI
-void
-ai_random_move( GameCtx *ctx ) {
+/*
+	pondering: while the human thinks, the engine searches the position
+	after the reply it expects (the second move of its last PV)
 
-	printf("AI move debug\n");
+	the ponder thread works on its own copy of the position, so it never
+	touches the GameCtx that parse_cmd and do_move change, and it's
+	stopped and joined before the engine searches for real
+*/
+typedef
+struct {
+	bool enabled;
+	bool running;		// there is a thread that hasn't been joined yet
+	bool hit;			// the human played the predicted move
+	atomic_bool done;
+	Engine *engine;
+	SearchLimits limits;	// the engine's own limits, put back after pondering
+	Move predicted;
+	Position pos;
+	pthread_t thread;
+	SearchResult result;
+} Ponder;
+
+static Ponder ponder;
+
+static void *
+ponder_thread(void *arg){
+	(void)arg;
+	ponder.result = search(ponder.engine, &(ponder.pos));
+	atomic_store(&(ponder.done), true);
+	return NULL;
+}
 
-	int ran_i, j;
-	MoveList *mvptr;
+static void
+ponder_start(GameCtx *ctx, const SearchResult *res){
 
-	// choose random piece
-	bool chosen = false;
-	while (!chosen) {
-		ran_i = RANDINT(12);
-		uint8_t square;
-		j = 0;
-		for ( int i = 0; i<32; ++i) {
-			if ( ctx->board[i] == 'b' || ctx->board[i] == 'B' ) {
-				j++;
-				if (j == ran_i) {
-					square = i+1;
-					break;
-				}
-			}
-		}
-		select_piece(ctx, square);
-		printf("Selected piece on square %d\n", square);
+	ponder.hit = false;
+	if (!ponder.enabled || res->book || res->pv_len < 2) return;
 
-		if (ctx->available_moves_len > 0) chosen = true;
+	ponder.engine = ctx->engine;
+	ponder.predicted = res->pv[1];
+	ponder.pos = ctx->pos;
+	position_apply(&(ponder.pos), ponder.predicted);
 
-		
-	}
+	// as deep as the real search may go, but without the clock and quietly
+	ponder.limits = ctx->engine->limits;
+	search_limits_default(&(ctx->engine->limits));
+	ctx->engine->limits.max_depth = ponder.limits.max_depth;
 
-	mvptr = ctx->available_moves;
+	atomic_store(&(ponder.done), false);
+	ponder.running = pthread_create(&(ponder.thread), NULL, ponder_thread, NULL) == 0;
+	if (!ponder.running)
+		ctx->engine->limits = ponder.limits;
+}
+
+/* stops pondering, "played" is the human's move (NULL if there isn't one) */
+static void
+ponder_stop(const Move *played){
 
-	ran_i = RANDINT(ctx->available_moves_len);
+	struct timespec ms = { 0, 1000000 };
 
-	j = 0;
-	while (mvptr->next != NULL && j<ran_i) {
-		mvptr = mvptr->next;
-		j++;
+	if (!ponder.running) return;
+
+	// search() clears the flag when it starts, so keep setting it until it's over
+	while (!atomic_load(&(ponder.done))) {
+		atomic_store(&(ponder.engine->stop), true);
+		nanosleep(&ms, NULL);
 	}
+	pthread_join(ponder.thread, NULL);
+
+	ponder.running = false;
+	ponder.engine->limits = ponder.limits;
+	ponder.hit = played && move_equal(*played, ponder.predicted, false);
+}
 
+// AI
+void
+ai_search_move( GameCtx *ctx ) {
+
+	SearchLimits limits = ctx->engine->limits;
+	SearchResult res;
+
+	/*
+		after a ponder hit the engine has been thinking about this position
+		all along: if that was enough for the move's budget it answers at once,
+		otherwise it only spends the rest (the table is warm from pondering)
+	*/
+	bool enough = ponder.hit && ponder.result.depth > 0 &&
+	              ((limits.time_limit > 0 && ponder.result.elapsed >= limits.time_limit) ||
+	               (limits.node_limit && ponder.result.nodes >= limits.node_limit) ||
+	               ponder.result.depth >= limits.max_depth);
+
+	if (enough) {
+		res = ponder.result;
+		printf("ponder hit, ");
+	}
+	else {
+		if (ponder.hit && limits.time_limit > 0) {
+			double left = limits.time_limit - ponder.result.elapsed;
+			ctx->engine->limits.time_limit = left > limits.time_limit / 10 ? left : limits.time_limit / 10;
+		}
+		res = search(ctx->engine, &(ctx->pos));
+		ctx->engine->limits = limits;
+	}
+	ponder.hit = false;
+
+	printf("depth %d, score %d, %llu nodes in %.3f s\n", res.depth, res.score,
+	       (unsigned long long)res.nodes, res.elapsed);
+	if (ctx->engine->threads > 1 && !enough)
+		engine_print_threads(ctx->engine, &res);
 	printf("chosen move: ");
-	move_print(mvptr->value);
+	move_print(res.best);
 	putchar('\n');
-	do_move(ctx, mvptr->value);
-	movelist_append(&(ctx->movelist), mvptr->value, &(ctx->movelist_len));
+	do_move(ctx, res.best);
+
+	ponder_start(ctx, &res);
+}
+
+/*
+	checkers [-t seconds] [-n nodes] [-d depth] [-m hash MB] [-j threads]
+	         [-e tablebase dir] [-o opening book] [-p 0|1 (ponder)] [-u network]
+	         [-a alphabeta|uct|puct] [-b game database]
+	sets what the engine may spend on one move and which search it runs
+	(with uct and puct the node limit counts playouts and the depth is
+	turned into playouts, see mcts.c)
+*/
+static bool
+parse_limits(int argc, char *argv[], SearchLimits *limits, size_t *hash_mb, int *threads, int *kind){
+
+	search_limits_default(limits);
+	limits->time_limit = 1.0;
+	limits->verbose = true;
+	ponder.enabled = true;
+
+	for (int i = 1; i<argc; ++i) {
+		if (i + 1 >= argc) return false;
+		if (strcmp(argv[i], "-t") == 0)      limits->time_limit = atof(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0) limits->node_limit = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-d") == 0) limits->max_depth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0) *hash_mb = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-j") == 0) *threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-p") == 0) ponder.enabled = atoi(argv[++i]) != 0;
+		else if (strcmp(argv[i], "-e") == 0) tb_init(argv[++i], TB_MAX_PIECES);
+		else if (strcmp(argv[i], "-a") == 0) {
+			if ((*kind = engine_kind(argv[++i])) < 0) return false;
+		}
+		else if (strcmp(argv[i], "-u") == 0) {
+			if (!nnue_load(argv[++i])) {
+				printf("Couldn't load the network %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "-b") == 0) {
+			if (!gamedb_open(argv[++i])) {
+				printf("Couldn't open the game database %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "-o") == 0) {
+			if (!book_open(argv[++i])) {
+				printf("Couldn't open the book %s\n", argv[i]);
+				return false;
+			}
+		}
+		else return false;
+	}
+
+	return true;
 }
 
 int
 main(int argc, char *argv[]){
 
-	#ifdef _WIN32
-		srand((unsigned int)time(NULL));
-	#else
-	#ifdef __linux__
-		srand((unsigned int)time(NULL));
-	#endif
-	#endif
+	stats_init();
+
+	if (argc > 1 && strcmp(argv[1], "perft") == 0)
+		return perft_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "smp") == 0)
+		return smp_main(argc - 1, argv + 1);
+	if (argc > 1 && (strcmp(argv[1], "tbgen") == 0 || strcmp(argv[1], "tbprobe") == 0))
+		return tb_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "book") == 0)
+		return book_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "selfplay") == 0)
+		return selfplay_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "pdn") == 0)
+		return pdn_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "protocol") == 0)
+		return protocol_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "nnue") == 0)
+		return nnue_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "solve") == 0)
+		return solve_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "server") == 0)
+		return server_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "loadgen") == 0)
+		return loadgen_main(argc - 1, argv + 1);
+	if (argc > 1 && strcmp(argv[1], "db") == 0)
+		return gamedb_main(argc - 1, argv + 1);
+
+	SearchLimits limits;
+	size_t hash_mb = TT_DEFAULT_MB;
+	int threads = 1, kind = ENGINE_ALPHABETA;
+	if (!parse_limits(argc, argv, &limits, &hash_mb, &threads, &kind)) {
+		printf("usage: %s [-t seconds] [-n nodes] [-d depth] [-m hash MB] [-j threads]\n"
+		       "                 [-e tablebase dir] [-o opening book] [-p 0|1] [-u network]\n"
+		       "                 [-a alphabeta|uct|puct] [-b game database]\n"
+		       "       %s perft <depth> [FEN] | perft check\n"
+		       "       %s smp <depth> [threads] [FEN]\n"
+		       "       %s tbgen <pieces> [threads] [dir] | tbprobe <FEN> [dir]\n"
+		       "       %s book build <out> <games>... | book probe <book> [FEN]\n"
+		       "       %s selfplay <out> <games> [-w workers] [-d depth] [-n nodes] ...\n"
+		       "       %s pdn <archive> [-o out]\n"
+		       "       %s protocol\n"
+		       "       %s nnue bootstrap <out> | nnue check <net> [FEN]\n"
+		       "       %s solve <FEN> [-d plies] [-n nodes] [-t seconds] [-m MB] [-j threads] ...\n"
+		       "       %s server [-p port] [-g games] [-w workers] [-t seconds] [-b seconds per game] ...\n"
+		       "       %s loadgen [-p port] [-c connections] [-g games] [-s seed]\n"
+		       "       %s db build <out> <archives>... [-j threads] [-m MB] | db query <database> [FEN]\n",
+		       argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+		       argv[0], argv[0], argv[0], argv[0]);
+		return 1;
+	}
+
+	if (!tt_init(hash_mb)) {
+		printf("Couldn't allocate a %zu MB hash table\n", hash_mb);
+		return 1;
+	}
+
+	Engine engine;
+	if (!engine_init(&engine, threads)) {
+		printf("Couldn't set up %d search threads\n", threads);
+		return 1;
+	}
+	engine.limits = limits;
+	engine.kind = kind;
+	engine.use_book = book_ready();
+	engine.book_seed = (uint64_t)time(NULL) | 1;
 
 	GameCtx gmctx;
+	gmctx.engine = &engine;
 
-	uint8_t neighbors[4];
-	setup_board(gmctx.board);
+	setup_board(&(gmctx.pos));
+	putc('\n', stdout);
 	char cmd[8];
 	
-	gmctx.movelist = NULL;
-	gmctx.movelist_len = 0;
-	gmctx.available_moves = NULL;
-	gmctx.available_moves_len = 0;
+	memset(&(gmctx.history), 0, sizeof gmctx.history);
+	movebuf_clear(&(gmctx.available_moves));
 
 	gmctx.selected_piece = 0;
+	gmctx.legal.valid = false;
 
 	gmctx.player = true;
+	gmctx.quit = false;
 
 	while (!gmctx.quit){
 
+		COLOR turn = gmctx.pos.turn;
+		if ( legal_moves(&gmctx)->moves.len == 0 ) {
+			print_board(&(gmctx.pos));
+			printf("%s has no moves left, %s wins!\n",
+			       turn == BLACK ? "Black" : "White", turn == BLACK ? "White" : "Black");
+			break;
+		}
+
 		if (gmctx.player) {
-			print_board(gmctx.board);
+			print_board(&(gmctx.pos));
 			putc('>',stdout);
-			scanf("%7[^\n]", cmd);
+			double asked = clock_seconds();
+			if (scanf("%7[^\n]", cmd) == EOF) {
+				gmctx.quit = true;
+				break;
+			}
 			getchar();
+			STAT_TIME(STAT_TIME_INPUT, asked);
 			bool error;
 			Move move = parse_cmd(&gmctx, cmd, &error);
-			if (!error && move.from){
+			if (!error && MOVE_FROM(move)){
 
 				bool valid_move = do_move(&gmctx, move);
 
 				if (!valid_move)
-					printf("That move is invalid!\n");
+					printf("That move is invalid!%s\n",
+					       legal_moves(&gmctx)->capture ? " You have to take." : "");
 				else {
 
-					movelist_append( &(gmctx.movelist), move, &(gmctx.movelist_len) );
+					// the move as played, the typed one may not know what it took
+					ponder_stop(&(gmctx.history.plies[gmctx.history.cur].move));
+
 					gmctx.player = false;
 
 				}
@@ -970,13 +795,21 @@ main(int argc, char *argv[]){
 			memset(cmd, 0, sizeof cmd);
 		}
 		else {
-			ai_random_move(&gmctx);
+			ai_search_move(&gmctx);
 			gmctx.player = true;
 		}
 	}
 
-	movelist_print(gmctx.movelist);
-	movelist_free(&(gmctx.movelist), &(gmctx.movelist_len));
+	ponder_stop(NULL);
+	frame_close();
+	history_print(&(gmctx.history));
+	history_free(&(gmctx.history));
+	engine_free(&engine);
+	tt_free();
+	tb_close();
+	book_close();
+	gamedb_close();
+	nnue_free();
 
 	return 0;
 }
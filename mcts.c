@@ -0,0 +1,492 @@
+#include <math.h>
+#include <pthread.h>
+
+#include "checkers.h"
+
+/*
+	Monte Carlo tree search, the engine's other kind of search
+	(engine->kind is ENGINE_UCT or ENGINE_PUCT, search() hands those over)
+
+	every playout walks down the tree to a leaf choosing by UCT, or by PUCT
+	with priors from the evaluation of the moves, adds the leaf's moves to
+	the tree once it has been played out from before, and plays random
+	moves from there until the game is over
+	the result goes back up the path, every node keeps it from the point of
+	view of the side that played its move
+
+	the nodes live in one arena that's allocated by the first search and
+	handed out again from the start by every search after it, a node's
+	children sit next to each other in it, so nothing is allocated while
+	searching, and when it's full the leaves just stay leaves
+
+	all the engine's threads work on the same tree (tree parallelism): a
+	thread on its way down adds a virtual loss to every node it passes,
+	so the others go somewhere else until its playout is back
+
+	the playouts pick their moves uniformly from the generated moves with
+	a xoshiro256** generator of their own, one per thread
+
+	there's no depth to stop at, so a depth limit is turned into playouts:
+	MCTS_DEPTH_PLAYOUTS for depth 0, twice as many for every ply on top,
+	about how a full width search grows (see mcts_depth_playouts)
+*/
+
+#define MCTS_DEFAULT_MB	64
+#define MCTS_MAX_DEPTH	MAX_PLY
+
+// a playout that goes on this long is judged by the evaluation
+#define MCTS_PLAYOUT_PLIES	200
+#define MCTS_ADJUDICATE		100
+
+// the exploration constants of UCT and PUCT
+#define MCTS_UCT_C	1.0
+#define MCTS_PUCT_C	1.5
+// what an unvisited child is worth to PUCT (a loss would make it look worse than it is)
+#define MCTS_FPU	0.5
+// the priors are a softmax of the moves' evaluations, in hundredths of a man
+#define MCTS_PRIOR_TEMP	60.0
+
+#define MCTS_VIRTUAL_LOSS	1
+// playouts a thread runs between looking at the limits
+#define MCTS_CHECK_INTERVAL	16
+// what a depth limit of 0 is worth in playouts
+#define MCTS_DEPTH_PLAYOUTS	64
+// the main thread's info lines while it searches
+#define MCTS_REPORT_SECONDS	1.0
+
+#define MCTS_SEED	0x6d637473ull
+
+enum { MCTS_LEAF, MCTS_EXPANDING, MCTS_EXPANDED, MCTS_FULL };
+
+typedef
+struct {
+	Move move;		// the move that led here
+	uint32_t first;		// where the children start in the arena
+	uint16_t count;		// how many children there are (0 with no moves)
+	_Atomic uint8_t state;
+	float prior;
+	atomic_uint visits;
+	atomic_int virtual_loss;
+	atomic_uint_fast64_t score;	// in half points, for the side that played "move"
+} MctsNode;
+
+struct mcts_tree {
+	MctsNode *nodes;
+	uint32_t capacity;
+	atomic_uint used;
+};
+
+/* xoshiro256** (Blackman and Vigna), seeded with splitmix64 */
+typedef
+struct {
+	uint64_t s[4];
+} Xoshiro;
+
+static uint64_t
+rotl(uint64_t x, int k){
+	return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t
+xoshiro_next(Xoshiro *r){
+
+	uint64_t result = rotl(r->s[1] * 5, 7) * 9;
+	uint64_t t = r->s[1] << 17;
+
+	r->s[2] ^= r->s[0];
+	r->s[3] ^= r->s[1];
+	r->s[1] ^= r->s[2];
+	r->s[0] ^= r->s[3];
+	r->s[2] ^= t;
+	r->s[3] = rotl(r->s[3], 45);
+
+	return result;
+}
+
+static void
+xoshiro_seed(Xoshiro *r, uint64_t seed){
+	for (int i = 0; i<4; ++i)
+		r->s[i] = splitmix64(&seed);
+}
+
+/* a number below "n" with a multiply rather than a modulo (or retries) */
+static uint32_t
+xoshiro_below(Xoshiro *r, uint32_t n){
+	return (uint32_t)(((xoshiro_next(r) >> 32) * n) >> 32);
+}
+
+/*
+	plays random moves from "start" until a side has none left,
+	returns the half points the side to move at "start" got
+*/
+static int
+mcts_playout(const Position *start, Xoshiro *rng){
+
+	Position pos = *start;
+	MoveBuf buf;
+
+	STAT_INC(STAT_PLAYOUTS);
+
+	for (int ply = 0; ply<MCTS_PLAYOUT_PLIES; ++ply) {
+		generate_moves(&pos, pos.turn, &buf);
+		if (buf.len == 0)
+			return pos.turn == start->turn ? 0 : 2;
+		position_apply(&pos, buf.moves[xoshiro_below(rng, buf.len)]);
+	}
+
+	int score = evaluate(&pos) * (pos.turn == start->turn ? 1 : -1);
+	return score >= MCTS_ADJUDICATE ? 2 : score <= -MCTS_ADJUDICATE ? 0 : 1;
+}
+
+static void
+mcts_node_init(MctsNode *node, Move m, float prior){
+	node->move = m;
+	node->first = 0;
+	node->count = 0;
+	node->prior = prior;
+	atomic_init(&(node->state), MCTS_LEAF);
+	atomic_init(&(node->visits), 0);
+	atomic_init(&(node->virtual_loss), 0);
+	atomic_init(&(node->score), 0);
+}
+
+/*
+	gives "node" its children, only one thread gets to do it
+	returns false if another one is at it or the arena is full
+*/
+static bool
+mcts_expand(MctsTree *tree, MctsNode *node, const Position *pos, int kind){
+
+	uint8_t leaf = MCTS_LEAF;
+	MoveBuf buf;
+
+	if (!atomic_compare_exchange_strong(&(node->state), &leaf, MCTS_EXPANDING))
+		return false;
+
+	generate_moves(pos, pos->turn, &buf);
+
+	uint32_t first = atomic_load(&(tree->used));
+	if (first + buf.len > tree->capacity ||
+	    (first = atomic_fetch_add(&(tree->used), buf.len)) + buf.len > tree->capacity) {
+		atomic_store(&(node->state), MCTS_FULL);
+		return false;
+	}
+
+	// PUCT's priors: the better a move looks to the evaluation, the more it gets
+	double weights[MAX_MOVES], sum = 0;
+	for (int i = 0; i<buf.len; ++i) {
+		weights[i] = 1;
+		if (kind == ENGINE_PUCT) {
+			Position child = *pos;
+			position_apply(&child, buf.moves[i]);
+			weights[i] = exp(-evaluate(&child) / MCTS_PRIOR_TEMP);
+		}
+		sum += weights[i];
+	}
+
+	for (int i = 0; i<buf.len; ++i)
+		mcts_node_init(&(tree->nodes[first + i]), buf.moves[i], weights[i] / sum);
+
+	node->first = first;
+	node->count = buf.len;
+	atomic_store_explicit(&(node->state), MCTS_EXPANDED, memory_order_release);
+
+	return true;
+}
+
+/* the child to go down to, a visit that's on its way counts as a loss */
+static MctsNode *
+mcts_select(const MctsTree *tree, const MctsNode *node, int kind){
+
+	uint32_t parent = atomic_load_explicit(&(node->visits), memory_order_relaxed) +
+	                  atomic_load_explicit(&(node->virtual_loss), memory_order_relaxed);
+	double log_parent = log(parent + 1), sqrt_parent = sqrt(parent + 1);
+	MctsNode *best = &(tree->nodes[node->first]);
+	double best_value = -1;
+
+	for (int i = 0; i<node->count; ++i) {
+		MctsNode *child = &(tree->nodes[node->first + i]);
+		uint32_t n = atomic_load_explicit(&(child->visits), memory_order_relaxed) +
+		             atomic_load_explicit(&(child->virtual_loss), memory_order_relaxed);
+		double q = n ? atomic_load_explicit(&(child->score), memory_order_relaxed) / (2.0 * n) : MCTS_FPU;
+		double value;
+
+		if (kind == ENGINE_PUCT)
+			value = q + MCTS_PUCT_C * child->prior * sqrt_parent / (1 + n);
+		else if (n == 0)
+			return child;
+		else
+			value = q + MCTS_UCT_C * sqrt(log_parent / n);
+
+		if (value > best_value) {
+			best_value = value;
+			best = child;
+		}
+	}
+
+	return best;
+}
+
+/* the playouts a depth limit stands for */
+static uint64_t
+mcts_depth_playouts(int depth){
+	if (depth < 0) depth = 0;
+	if (depth >= MAX_DEPTH) return UINT64_MAX;
+	return (uint64_t)MCTS_DEPTH_PLAYOUTS << depth;
+}
+
+static bool
+mcts_should_stop(SearchCtx *ctx){
+
+	Engine *engine = ctx->engine;
+
+	if (atomic_load_explicit(&(engine->stop), memory_order_relaxed)) return true;
+	if (ctx->nodes == 0 || ctx->nodes % MCTS_CHECK_INTERVAL != 0) return false;
+
+	uint64_t playouts = atomic_fetch_add_explicit(&(engine->nodes), MCTS_CHECK_INTERVAL,
+	                                              memory_order_relaxed) + MCTS_CHECK_INTERVAL;
+
+	uint64_t limit = mcts_depth_playouts(engine->limits.max_depth);
+	if (engine->limits.node_limit && engine->limits.node_limit < limit)
+		limit = engine->limits.node_limit;
+
+	if (playouts >= limit)
+		atomic_store(&(engine->stop), true);
+	if (ctx->id == 0 && engine->limits.time_limit > 0 &&
+	    clock_seconds() - engine->start >= engine->limits.time_limit)
+		atomic_store(&(engine->stop), true);
+
+	return atomic_load(&(engine->stop));
+}
+
+/* the most visited child */
+static MctsNode *
+mcts_best(const MctsTree *tree, const MctsNode *node){
+
+	MctsNode *best = NULL;
+
+	if (atomic_load(&(node->state)) != MCTS_EXPANDED) return NULL;
+
+	for (int i = 0; i<node->count; ++i) {
+		MctsNode *child = &(tree->nodes[node->first + i]);
+		if (best == NULL || atomic_load(&(child->visits)) > atomic_load(&(best->visits)))
+			best = child;
+	}
+
+	return best && atomic_load(&(best->visits)) ? best : NULL;
+}
+
+/* the most visited line, with the win rate turned into a score (0.5 is 0, a percent is 20) */
+static void
+mcts_result(const Engine *engine, SearchResult *res){
+
+	const MctsTree *tree = engine->tree;
+	const MctsNode *node = &(tree->nodes[0]);
+	MctsNode *child;
+
+	res->pv_len = 0;
+	while (res->pv_len < MAX_PLY && (child = mcts_best(tree, node)) != NULL) {
+		res->pv[res->pv_len++] = child->move;
+		node = child;
+	}
+
+	res->best = res->pv_len ? res->pv[0] : MOVE_NONE;
+	res->score = 0;
+	if (res->pv_len) {
+		child = mcts_best(tree, &(tree->nodes[0]));
+		double q = atomic_load(&(child->score)) / (2.0 * atomic_load(&(child->visits)));
+		res->score = (int)((q - 0.5) * 2000);
+	}
+}
+
+static void
+mcts_report(const Engine *engine, SearchResult *res){
+
+	char notation[4 * (MAX_CAPTURES + 1)];
+	double elapsed = clock_seconds() - engine->start;
+	uint64_t playouts = 0;
+	int depth = 0;
+
+	for (int i = 0; i<engine->threads; ++i) {
+		playouts += engine->workers[i].nodes;
+		if (engine->workers[i].result.depth > depth) depth = engine->workers[i].result.depth;
+	}
+	mcts_result(engine, res);
+
+	printf("info playouts %llu time %.3f pps %.0f pps/thread %.0f tree %u depth %d score %d pv",
+	       (unsigned long long)playouts, elapsed, elapsed > 0 ? playouts / elapsed : 0.0,
+	       elapsed > 0 ? playouts / elapsed / engine->threads : 0.0,
+	       atomic_load(&(engine->tree->used)), depth, res->score);
+	for (int i = 0; i<res->pv_len && i<8; ++i) {
+		move_format_path(res->pv[i], notation);
+		printf(" %s", notation);
+	}
+	putchar('\n');
+	fflush(stdout);
+}
+
+/* one thread's playouts, until the engine stops */
+static void
+mcts_iterate(SearchCtx *ctx){
+
+	Engine *engine = ctx->engine;
+	MctsTree *tree = engine->tree;
+	MctsNode *path[MCTS_MAX_DEPTH + 1];
+	Xoshiro rng;
+	double next_report = MCTS_REPORT_SECONDS;
+
+	stats_thread_start();
+	xoshiro_seed(&rng, MCTS_SEED + (uint64_t)ctx->id * 0x9E3779B97F4A7C15ull);
+
+	while (!mcts_should_stop(ctx)) {
+
+		Position pos = ctx->pos;
+		MctsNode *node = &(tree->nodes[0]);
+		int depth = 0, result;
+
+		path[0] = node;
+		atomic_fetch_add_explicit(&(node->virtual_loss), MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+
+		for (;;) {
+			uint8_t state = atomic_load_explicit(&(node->state), memory_order_acquire);
+
+			// a leaf gets its children the second time it's reached
+			if (state == MCTS_LEAF && atomic_load_explicit(&(node->visits), memory_order_relaxed) > 0 &&
+			    mcts_expand(tree, node, &pos, engine->kind))
+				state = MCTS_EXPANDED;
+
+			if (state != MCTS_EXPANDED || depth == MCTS_MAX_DEPTH) {
+				result = mcts_playout(&pos, &rng);
+				break;
+			}
+			// no moves, lost
+			if (node->count == 0) {
+				result = 0;
+				break;
+			}
+
+			node = mcts_select(tree, node, engine->kind);
+			position_apply(&pos, node->move);
+			path[++depth] = node;
+			atomic_fetch_add_explicit(&(node->virtual_loss), MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+		}
+
+		// "result" is for the side to move at the leaf, which didn't play the leaf's move
+		for (int i = depth; i>=0; --i) {
+			result = 2 - result;
+			atomic_fetch_add_explicit(&(path[i]->score), result, memory_order_relaxed);
+			atomic_fetch_add_explicit(&(path[i]->visits), 1, memory_order_relaxed);
+			atomic_fetch_sub_explicit(&(path[i]->virtual_loss), MCTS_VIRTUAL_LOSS, memory_order_relaxed);
+		}
+
+		ctx->nodes++;
+		if (depth > ctx->result.depth) ctx->result.depth = depth;
+
+		if (ctx->id == 0 && engine->limits.verbose && clock_seconds() - engine->start >= next_report) {
+			mcts_report(engine, &(ctx->result));
+			next_report += MCTS_REPORT_SECONDS;
+		}
+	}
+
+	STAT_ADD(STAT_NODES, ctx->nodes);
+}
+
+static void *
+mcts_thread(void *arg){
+	mcts_iterate((SearchCtx *)arg);
+	return NULL;
+}
+
+/*
+	searches "pos" with all the engine's threads, called by search() (which
+	has set the clock and checked for the book and for no moves at all)
+	the node count is the number of playouts
+*/
+SearchResult
+mcts_search(Engine *engine, const Position *pos){
+
+	pthread_t handles[MAX_THREADS];
+	MctsTree *tree = engine->tree;
+	SearchResult res;
+
+	memset(&res, 0, sizeof res);
+
+	if (tree == NULL) {
+		size_t capacity = (size_t)MCTS_DEFAULT_MB * 1024 * 1024 / sizeof(MctsNode);
+		tree = calloc(1, sizeof(MctsTree));
+		if (tree) tree->nodes = malloc(capacity * sizeof(MctsNode));
+		if (tree == NULL || tree->nodes == NULL) {
+			free(tree);
+			return res;
+		}
+		tree->capacity = capacity;
+		engine->tree = tree;
+	}
+
+	atomic_store(&(tree->used), 1);
+	mcts_node_init(&(tree->nodes[0]), MOVE_NONE, 1);
+	atomic_store(&(tree->nodes[0].visits), 1);
+	mcts_expand(tree, &(tree->nodes[0]), pos, engine->kind);
+
+	// only one move, nothing to think about
+	if (tree->nodes[0].count == 1 && (engine->limits.time_limit > 0 || engine->limits.node_limit)) {
+		res.best = res.pv[0] = tree->nodes[1].move;
+		res.pv_len = 1;
+		res.elapsed = clock_seconds() - engine->start;
+		return res;
+	}
+
+	for (int i = 0; i<engine->threads; ++i) {
+		SearchCtx *ctx = &(engine->workers[i]);
+		ctx->engine = engine;
+		ctx->id = i;
+		ctx->pos = *pos;
+		ctx->nodes = 0;
+		ctx->result.depth = 0;
+	}
+
+	int started = 1;
+	for (int i = 1; i<engine->threads; ++i, ++started)
+		if (pthread_create(&(handles[i]), NULL, mcts_thread, &(engine->workers[i])) != 0)
+			break;
+
+	mcts_iterate(&(engine->workers[0]));
+
+	atomic_store(&(engine->stop), true);
+	for (int i = 1; i<started; ++i)
+		pthread_join(handles[i], NULL);
+
+	for (int i = 0; i<engine->threads; ++i) {
+		res.nodes += engine->workers[i].nodes;
+		if (engine->workers[i].result.depth > res.depth) res.depth = engine->workers[i].result.depth;
+	}
+	mcts_result(engine, &res);
+	res.elapsed = clock_seconds() - engine->start;
+	if (engine->limits.verbose) mcts_report(engine, &res);
+	STAT_TIME(STAT_TIME_SEARCH, engine->start);
+
+	return res;
+}
+
+void
+mcts_free(Engine *engine){
+	if (engine->tree) free(engine->tree->nodes);
+	free(engine->tree);
+	engine->tree = NULL;
+}
+
+static const char *ENGINE_KIND_NAMES[] = { "alphabeta", "uct", "puct" };
+
+/* ENGINE_UCT for "uct" and so on, -1 if there's no such search */
+int
+engine_kind(const char *name){
+	for (int i = 0; i<3; ++i)
+		if (strcmp(name, ENGINE_KIND_NAMES[i]) == 0)
+			return i;
+	return -1;
+}
+
+const char *
+engine_kind_name(int kind){
+	return kind >= 0 && kind < 3 ? ENGINE_KIND_NAMES[kind] : "?";
+}
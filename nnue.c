@@ -0,0 +1,410 @@
+#if defined(__AVX2__) || defined(__SSSE3__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "checkers.h"
+
+/*
+	a small efficiently updatable neural network evaluation
+
+	the inputs are piece type x square, seen from one side ("perspective"):
+	our men, our kings, their men and their kings on the 32 squares, with
+	the board turned around for white so both sides see themselves moving
+	up the same way
+	the first layer's sums (the accumulator) are kept for both perspectives
+	and only change by the few pieces a move touches, so the search updates
+	them on every make (one accumulator per ply, unmake is going back a ply)
+
+		128 inputs -> NNUE_L1 (int16, per perspective)
+		clipped to 0..127, side to move's half first -> 2 * NNUE_L1 (uint8)
+		-> NNUE_L2 (int8 weights, int32 sums, >> NNUE_SHIFT, clipped to 0..127)
+		-> 1 (int8 weights) * output_scale / 256 = the score
+
+	the second layer runs with AVX2 or SSSE3 when the compiler is allowed to
+	use them (make native), with SSE2 (which every x86-64 has, so the plain
+	make gets it) or else with the plain loop
+*/
+
+#define NNUE_MAGIC   "CKNN"
+#define NNUE_VERSION 1
+#define NNUE_SHIFT   6
+
+typedef
+struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t inputs;
+	uint32_t l1;
+	uint32_t l2;
+	int32_t output_scale;
+} NnueHeader;
+
+typedef
+struct {
+	int16_t w1[NNUE_INPUTS][NNUE_L1];
+	int16_t b1[NNUE_L1];
+	int8_t  w2[NNUE_L2][2 * NNUE_L1];
+	int32_t b2[NNUE_L2];
+	int8_t  w3[NNUE_L2];
+	int32_t b3;
+	int32_t output_scale;
+	// w2 widened to int16 when it's loaded, SSE2 has no uint8 x int8 multiply
+	int16_t w2_wide[NNUE_L2][2 * NNUE_L1];
+} NnueNet;
+
+static NnueNet *net = NULL;
+
+bool
+nnue_ready(void){
+	return net != NULL;
+}
+
+void
+nnue_free(void){
+	free(net);
+	net = NULL;
+}
+
+/* loads a weights file, the header has to match this build's layer sizes */
+bool
+nnue_load(const char *path){
+
+	NnueHeader h;
+	NnueNet *n = malloc(sizeof(NnueNet));
+	FILE *f = fopen(path, "rb");
+
+	bool ok = n && f && fread(&h, sizeof h, 1, f) == 1 &&
+	          memcmp(h.magic, NNUE_MAGIC, 4) == 0 && h.version == NNUE_VERSION &&
+	          h.inputs == NNUE_INPUTS && h.l1 == NNUE_L1 && h.l2 == NNUE_L2 &&
+	          fread(n->w1, sizeof n->w1, 1, f) == 1 && fread(n->b1, sizeof n->b1, 1, f) == 1 &&
+	          fread(n->w2, sizeof n->w2, 1, f) == 1 && fread(n->b2, sizeof n->b2, 1, f) == 1 &&
+	          fread(n->w3, sizeof n->w3, 1, f) == 1 && fread(&(n->b3), sizeof n->b3, 1, f) == 1;
+
+	if (f) fclose(f);
+	if (!ok) {
+		free(n);
+		return false;
+	}
+
+	n->output_scale = h.output_scale;
+	for (int o = 0; o<NNUE_L2; ++o)
+		for (int i = 0; i<2 * NNUE_L1; ++i)
+			n->w2_wide[o][i] = n->w2[o][i];
+	nnue_free();
+	net = n;
+	return true;
+}
+
+static bool
+nnue_save(const NnueNet *n, const char *path){
+
+	NnueHeader h;
+	memcpy(h.magic, NNUE_MAGIC, 4);
+	h.version = NNUE_VERSION;
+	h.inputs = NNUE_INPUTS;
+	h.l1 = NNUE_L1;
+	h.l2 = NNUE_L2;
+	h.output_scale = n->output_scale;
+
+	FILE *f = fopen(path, "wb");
+	bool ok = f && fwrite(&h, sizeof h, 1, f) == 1 &&
+	          fwrite(n->w1, sizeof n->w1, 1, f) == 1 && fwrite(n->b1, sizeof n->b1, 1, f) == 1 &&
+	          fwrite(n->w2, sizeof n->w2, 1, f) == 1 && fwrite(n->b2, sizeof n->b2, 1, f) == 1 &&
+	          fwrite(n->w3, sizeof n->w3, 1, f) == 1 && fwrite(&(n->b3), sizeof n->b3, 1, f) == 1;
+	if (f && fclose(f) != 0) ok = false;
+
+	return ok;
+}
+
+/* the input of a piece of "color" on "square" (1-32) seen from "perspective" */
+static inline int
+nnue_feature(COLOR perspective, COLOR color, bool king, uint8_t square){
+	int type = (color == perspective ? 0 : 2) + king;
+	int sq = perspective == BLACK ? square - 1 : 32 - square;
+	return type * 32 + sq;
+}
+
+static inline void
+nnue_add(int16_t *acc, int feature){
+	const int16_t *w = net->w1[feature];
+	for (int i = 0; i<NNUE_L1; ++i) acc[i] += w[i];
+}
+
+static inline void
+nnue_sub(int16_t *acc, int feature){
+	const int16_t *w = net->w1[feature];
+	for (int i = 0; i<NNUE_L1; ++i) acc[i] -= w[i];
+}
+
+/* the accumulator of "pos" from scratch */
+void
+nnue_refresh(const Position *pos, NnueAccumulator *acc){
+
+	for (int p = 0; p<2; ++p) {
+		memcpy(acc->v[p], net->b1, sizeof acc->v[p]);
+		for (int color = 0; color<2; ++color) {
+			Bitboard pieces = pos->pieces[color];
+			while (pieces) {
+				uint8_t sq = bb_first_square(pieces);
+				pieces &= pieces - 1;
+				nnue_add(acc->v[p], nnue_feature(p, color, pos->kings & SQ_BIT(sq), sq));
+			}
+		}
+	}
+}
+
+/*
+	the accumulator after "m", from the one before it
+	"pos" is the position after make_move, "undo" what make_move returned
+*/
+void
+nnue_update(const NnueAccumulator *before, NnueAccumulator *after, const Position *pos,
+            Move m, const Undo *undo){
+
+	COLOR color = !pos->turn;
+	bool king = (pos->kings & SQ_BIT(MOVE_TO(m))) != 0;
+	bool was_king = king && !undo->promoted;
+
+	STAT_INC(STAT_NNUE_UPDATES);
+	*after = *before;
+
+	for (int p = 0; p<2; ++p) {
+		int16_t *acc = after->v[p];
+
+		nnue_sub(acc, nnue_feature(p, color, was_king, MOVE_FROM(m)));
+		nnue_add(acc, nnue_feature(p, color, king, MOVE_TO(m)));
+
+		Bitboard captured = undo->captured;
+		while (captured) {
+			uint8_t sq = bb_first_square(captured);
+			captured &= captured - 1;
+			nnue_sub(acc, nnue_feature(p, !color, undo->captured_kings & SQ_BIT(sq), sq));
+		}
+	}
+}
+
+/* the second layer: NNUE_L2 sums of 2 * NNUE_L1 uint8 x int8 products */
+static void
+nnue_layer2(const uint8_t *in, int32_t *out){
+
+#if defined(__AVX2__)
+	const __m256i ones = _mm256_set1_epi16(1);
+	for (int o = 0; o<NNUE_L2; ++o) {
+		__m256i sum = _mm256_setzero_si256();
+		for (int i = 0; i<2 * NNUE_L1; i += 32) {
+			__m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+			__m256i w = _mm256_loadu_si256((const __m256i *)(net->w2[o] + i));
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+		}
+		__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+		out[o] = _mm_cvtsi128_si32(s) + net->b2[o];
+	}
+#elif defined(__SSSE3__)
+	const __m128i ones = _mm_set1_epi16(1);
+	for (int o = 0; o<NNUE_L2; ++o) {
+		__m128i sum = _mm_setzero_si128();
+		for (int i = 0; i<2 * NNUE_L1; i += 16) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+			__m128i w = _mm_loadu_si128((const __m128i *)(net->w2[o] + i));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(x, w), ones));
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		out[o] = _mm_cvtsi128_si32(sum) + net->b2[o];
+	}
+#elif defined(__SSE2__)
+	// no maddubs: the inputs widened with zeros times the widened weights
+	const __m128i zero = _mm_setzero_si128();
+	__m128i x[2 * NNUE_L1 / 8];
+	for (int i = 0; i<2 * NNUE_L1; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		x[i / 8] = _mm_unpacklo_epi8(v, zero);
+		x[i / 8 + 1] = _mm_unpackhi_epi8(v, zero);
+	}
+	for (int o = 0; o<NNUE_L2; ++o) {
+		__m128i sum = _mm_setzero_si128();
+		for (int i = 0; i<2 * NNUE_L1 / 8; ++i) {
+			__m128i w = _mm_loadu_si128((const __m128i *)(net->w2_wide[o] + 8 * i));
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(x[i], w));
+		}
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		out[o] = _mm_cvtsi128_si32(sum) + net->b2[o];
+	}
+#else
+	for (int o = 0; o<NNUE_L2; ++o) {
+		int32_t sum = net->b2[o];
+		for (int i = 0; i<2 * NNUE_L1; ++i)
+			sum += in[i] * net->w2[o][i];
+		out[o] = sum;
+	}
+#endif
+}
+
+static inline uint8_t
+nnue_clip(int32_t x){
+	return x < 0 ? 0 : x > 127 ? 127 : x;
+}
+
+/* the score of the position the accumulator belongs to, for "turn" */
+int
+nnue_evaluate(const NnueAccumulator *acc, COLOR turn){
+
+	uint8_t in[2 * NNUE_L1];
+	int32_t hidden[NNUE_L2];
+
+	STAT_INC(STAT_NNUE_EVALS);
+
+	for (int i = 0; i<NNUE_L1; ++i) {
+		in[i] = nnue_clip(acc->v[turn][i]);
+		in[NNUE_L1 + i] = nnue_clip(acc->v[!turn][i]);
+	}
+
+	nnue_layer2(in, hidden);
+
+	int32_t sum = net->b3;
+	for (int o = 0; o<NNUE_L2; ++o)
+		sum += nnue_clip(hidden[o] >> NNUE_SHIFT) * net->w3[o];
+
+	return (int)((int64_t)sum * net->output_scale / 256);
+}
+
+/*
+	a network that plays like the hand written evaluation, to start from
+	until there is a trained one (and to check the plumbing against)
+
+	the first layer has a neuron for each square with our piece on it and
+	one for each square with theirs, holding half its eval.c value, the
+	second layer spreads the difference over 8 neurons each way (every one
+	takes the next 127), and the output adds them back up
+*/
+static void
+nnue_bootstrap(NnueNet *n){
+
+	memset(n, 0, sizeof *n);
+
+	int man[32], king[32];
+	for (int sq = 0; sq<32; ++sq) {
+		Position pos = { { SQ_BIT(sq + 1), 0 }, 0, BLACK, 0 };
+		man[sq] = (evaluate(&pos) + 1) / 2;
+		pos.kings = SQ_BIT(sq + 1);
+		king[sq] = (evaluate(&pos) + 1) / 2;
+	}
+
+	// feature types: our men, our kings, their men, their kings
+	// (the other side moves the other way, so theirs are worth the turned around square)
+	for (int sq = 0; sq<32; ++sq) {
+		n->w1[0 * 32 + sq][sq] = man[sq];
+		n->w1[1 * 32 + sq][sq] = king[sq];
+		n->w1[2 * 32 + sq][32 + sq] = man[31 - sq];
+		n->w1[3 * 32 + sq][32 + sq] = king[31 - sq];
+	}
+
+	for (int k = 0; k<8; ++k) {
+		for (int i = 0; i<32; ++i) {
+			n->w2[k][i] = 1 << NNUE_SHIFT;
+			n->w2[k][32 + i] = -(1 << NNUE_SHIFT);
+			n->w2[8 + k][i] = -(1 << NNUE_SHIFT);
+			n->w2[8 + k][32 + i] = 1 << NNUE_SHIFT;
+		}
+		n->b2[k] = n->b2[8 + k] = -127 * k * (1 << NNUE_SHIFT);
+		n->w3[k] = 1;
+		n->w3[8 + k] = -1;
+	}
+
+	n->output_scale = 512;
+}
+
+/*
+	checkers nnue bootstrap <out>      writes the network that mirrors eval.c
+	checkers nnue check <net> [FEN]    plays random games, comparing the
+	                                   incremental accumulators with fresh
+	                                   ones (and the hand written eval),
+	                                   and times the evaluation
+*/
+int
+nnue_main(int argc, char *argv[]){
+
+	if (argc >= 3 && strcmp(argv[1], "bootstrap") == 0) {
+		NnueNet *n = malloc(sizeof(NnueNet));
+		if (n == NULL) return 1;
+		nnue_bootstrap(n);
+		bool ok = nnue_save(n, argv[2]);
+		free(n);
+		printf(ok ? "wrote %s\n" : "Couldn't write %s\n", argv[2]);
+		return ok ? 0 : 1;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "check") == 0) {
+		Position start;
+		setup_board(&start);
+		if (argc >= 4 && !position_from_fen(&start, argv[3])) {
+			printf("Invalid FEN: %s\n", argv[3]);
+			return 1;
+		}
+		if (!nnue_load(argv[2])) {
+			printf("Couldn't load the network %s\n", argv[2]);
+			return 1;
+		}
+
+		NnueAccumulator acc[2], fresh;
+		uint64_t seed = 1, positions = 0, mismatches = 0;
+		int64_t diff = 0;
+
+		for (int game = 0; game<1000; ++game) {
+			Position pos = start;
+			nnue_refresh(&pos, &acc[0]);
+
+			for (int ply = 0; ply<100; ++ply) {
+				MoveBuf buf;
+				Undo undo;
+				generate_moves(&pos, pos.turn, &buf);
+				if (buf.len == 0) break;
+
+				seed ^= seed << 13;
+				seed ^= seed >> 7;
+				seed ^= seed << 17;
+				Move m = buf.moves[seed % buf.len];
+
+				make_move(&pos, m, &undo);
+				nnue_update(&acc[ply & 1], &acc[!(ply & 1)], &pos, m, &undo);
+				nnue_refresh(&pos, &fresh);
+
+				if (memcmp(&fresh, &acc[!(ply & 1)], sizeof fresh) != 0) mismatches++;
+				diff += abs(nnue_evaluate(&fresh, pos.turn) - evaluate(&pos));
+				positions++;
+			}
+		}
+
+		Position pos = start;
+		nnue_refresh(&pos, &fresh);
+		volatile int sink = 0;
+		double t = clock_seconds();
+		for (int i = 0; i<1000000; ++i) sink += nnue_evaluate(&fresh, i & 1);
+		double elapsed = clock_seconds() - t;
+
+		printf("%llu positions, %llu accumulator mismatches, %.2f average difference from eval.c\n",
+		       (unsigned long long)positions, (unsigned long long)mismatches,
+		       positions ? (double)diff / positions : 0.0);
+		printf("%.0f evaluations/s (%s)\n", 1000000 / (elapsed > 0 ? elapsed : 1e-9),
+#if defined(__AVX2__)
+		       "avx2"
+#elif defined(__SSSE3__)
+		       "ssse3"
+#elif defined(__SSE2__)
+		       "sse2"
+#else
+		       "scalar"
+#endif
+		       );
+
+		nnue_free();
+		return mismatches ? 1 : 0;
+	}
+
+	printf("usage: checkers nnue bootstrap <out>\n"
+	       "       checkers nnue check <net> [FEN]\n");
+	return 1;
+}
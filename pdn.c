@@ -0,0 +1,422 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkers.h"
+
+/*
+	PDN (portable draughts notation) game records
+
+	the reader maps the whole archive and walks it in place, a game is
+	the tag pairs in front of it and the move text up to its result:
+
+		[Event "..."]
+		[FEN "W:W21,22:BK1"]
+		1. 11-15 23-19 {a comment} 2. 8-11 (22-17 ...) 22-17 1-0
+
+	moves are taken in square numbers ("11-15", "15x22x29") or in
+	coordinates ("c3-d4", "c3xe5"), comments, variations and move
+	numbers are skipped, and every move is looked for among the moves
+	generated for its position and played on the reader's own copy of it
+	(one generation and one make_move a ply, no GameCtx and no history)
+*/
+
+#define PDN_LINE 80
+// a move number and a move with its whole route
+#define PDN_TOKEN (4 * (MAX_CAPTURES + 1) + 16)
+
+static bool
+pdn_space(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* maps "path" ("-" reads stdin into memory instead) */
+bool
+pdn_open(PdnReader *r, const char *path){
+
+	struct stat st;
+
+	memset(r, 0, sizeof *r);
+
+	if (strcmp(path, "-") == 0) {
+		size_t cap = 1 << 20;
+		char *data = malloc(cap);
+		size_t n;
+		while (data && (n = fread(data + r->len, 1, cap - r->len, stdin)) > 0) {
+			r->len += n;
+			if (r->len == cap) {
+				char *bigger = realloc(data, cap *= 2);
+				if (bigger == NULL) free(data);
+				data = bigger;
+			}
+		}
+		r->data = data;
+		r->owned = true;
+		return data != NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+
+	r->len = st.st_size;
+	if (r->len > 0) {
+		void *map = mmap(NULL, r->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		madvise(map, r->len, MADV_SEQUENTIAL);
+		r->data = map;
+	}
+	close(fd);
+
+	return true;
+}
+
+void
+pdn_close(PdnReader *r){
+	if (r->owned)
+		free((void *)r->data);
+	else if (r->data)
+		munmap((void *)r->data, r->len);
+	memset(r, 0, sizeof *r);
+}
+
+/*
+	the result at "c" if there is one, and how long it is
+	(both "1-0" and the 2 point "2-0" styles are read)
+*/
+static int
+pdn_result(const char *c, const char *end, int *result){
+
+	static const struct { const char *text; size_t len; int result; } RESULTS[] = {
+		{ "1-0", 3, PDN_BLACK_WINS }, { "2-0", 3, PDN_BLACK_WINS },
+		{ "0-1", 3, PDN_WHITE_WINS }, { "0-2", 3, PDN_WHITE_WINS },
+		{ "1/2-1/2", 7, PDN_DRAW },   { "1-1", 3, PDN_DRAW },
+		{ "*", 1, PDN_UNKNOWN },
+	};
+
+	if (*c != '0' && *c != '1' && *c != '2' && *c != '*') return 0;
+	// a move ("12-16") has a second digit before the dash
+	if (*c != '*' && end - c >= 2 && c[1] >= '0' && c[1] <= '9') return 0;
+
+	for (size_t i = 0; i<sizeof RESULTS / sizeof RESULTS[0]; ++i) {
+		size_t len = RESULTS[i].len;
+		if ((size_t)(end - c) >= len && memcmp(c, RESULTS[i].text, len) == 0 &&
+		    (c + len == end || pdn_space(c[len]))) {
+			*result = RESULTS[i].result;
+			return len;
+		}
+	}
+
+	return 0;
+}
+
+/* one square of a move, a number or a coordinate, 0 if it isn't one */
+static uint8_t
+pdn_square(const char **c, const char *end){
+
+	const char *p = *c;
+	int sq = 0;
+
+	if (p < end && *p >= 'a' && *p <= 'h') {
+		if (p + 1 >= end || p[1] < '1' || p[1] > '8') return 0;
+		sq = coord_to_square(p[0], p[1] - '0');
+		p += 2;
+	}
+	else {
+		while (p < end && *p >= '0' && *p <= '9' && sq <= 32) sq = sq * 10 + (*p++ - '0');
+		if (sq > 32) return 0;
+	}
+
+	*c = p;
+	return sq;
+}
+
+/* skips to the end of the game the reader is in (its result or the next tags) */
+static void
+pdn_skip_game(PdnReader *r){
+
+	const char *c = r->data + r->at, *end = r->data + r->len;
+	int result;
+	bool newline = false;
+
+	while (c < end) {
+		if (*c == '{')
+			while (c < end && *c != '}') c++;
+		else if (newline && *c == '[')
+			break;
+		else if (pdn_space(*c) && c + 1 < end && !pdn_space(c[1])) {
+			int len = pdn_result(c + 1, end, &result);
+			if (len) {
+				c += len + 1;
+				break;
+			}
+		}
+		newline = *c == '\n';
+		if (c < end) c++;
+	}
+
+	r->at = c - r->data;
+}
+
+/*
+	reads and replays the next game into "game"
+	returns PDN_EOF at the end of the archive, PDN_ILLEGAL if a move of
+	the game (game->len is how many were fine) or its FEN is wrong
+*/
+int
+pdn_next(PdnReader *r, PdnGame *game){
+
+	const char *c = r->data + r->at, *end = r->data + r->len;
+	bool started = false;	// has the move text begun
+	int depth = 0;			// how deep in nested variations
+	Position pos;
+	MoveBuf legal;
+
+	game->len = 0;
+	game->result = PDN_UNKNOWN;
+	game->fen = false;
+
+	setup_board(&pos);
+	game->start = pos;
+
+	while (c < end) {
+
+		if (pdn_space(*c)) { c++; continue; }
+
+		// a comment, or the rest of the line with ';'
+		if (*c == '{') {
+			while (c < end && *c != '}') c++;
+			if (c < end) c++;
+			continue;
+		}
+		if (*c == ';') {
+			while (c < end && *c != '\n') c++;
+			continue;
+		}
+
+		if (*c == '(') { depth++; c++; continue; }
+		if (*c == ')') { depth--; c++; continue; }
+		if (depth > 0) { c++; continue; }
+
+		// tags, the ones after the move text belong to the next game
+		if (*c == '[') {
+			if (started) break;
+			const char *tag = ++c;
+			while (c < end && *c != ']' && *c != '\n') c++;
+			if (end - tag > 4 && memcmp(tag, "FEN ", 4) == 0) {
+				game->fen = true;
+				char fen[256];
+				size_t len = (size_t)(c - tag - 4) < sizeof fen - 1 ? (size_t)(c - tag - 4) : sizeof fen - 1;
+				memcpy(fen, tag + 4, len);
+				fen[len] = '\0';
+				if (!position_from_fen(&pos, fen)) {
+					r->at = c - r->data;
+					pdn_skip_game(r);
+					return PDN_ILLEGAL;
+				}
+				game->start = pos;
+			}
+			if (c < end) c++;
+			continue;
+		}
+
+		int result, len = pdn_result(c, end, &result);
+		if (len) {
+			game->result = result;
+			c += len;
+			started = true;
+			break;
+		}
+
+		// annotations
+		if (*c == '$' || *c == '!' || *c == '?') {
+			while (c < end && !pdn_space(*c)) c++;
+			continue;
+		}
+
+		// a move number ("12." or "12...") or a move
+		const char *token = c;
+		if (*c >= '0' && *c <= '9') {
+			while (c < end && *c >= '0' && *c <= '9') c++;
+			if (c < end && *c == '.') {
+				while (c < end && *c == '.') c++;
+				continue;
+			}
+			c = token;
+		}
+
+		started = true;
+
+		// the whole route, captures with the same ends differ in between
+		uint8_t squares[MAX_CAPTURES + 1];
+		int n = 0;
+		squares[n++] = pdn_square(&c, end);
+		while (c < end && (*c == '-' || *c == 'x') && squares[n - 1] != 0) {
+			c++;
+			if (n == MAX_CAPTURES + 1) {
+				squares[0] = 0;
+				break;
+			}
+			squares[n++] = pdn_square(&c, end);
+		}
+		uint8_t from = squares[0], to = n >= 2 ? squares[n - 1] : 0;
+
+		// the generated move knows what it takes, the typed one doesn't
+		int index = -1;
+		if (from && to && game->len < PDN_MAX_PLIES) {
+			uint8_t path[MAX_CAPTURES + 1];
+			generate_moves(&pos, pos.turn, &legal);
+			for (int i = 0; i<legal.len && index < 0; ++i) {
+				Move m = legal.moves[i];
+				if (MOVE_FROM(m) == from && MOVE_TO(m) == to &&
+				    (n == 2 || (move_path(m, path) == n && memcmp(path, squares, n) == 0)))
+					index = i;
+			}
+		}
+		if (index < 0) {
+			r->at = token - r->data;
+			pdn_skip_game(r);
+			return PDN_ILLEGAL;
+		}
+
+		game->keys[game->len] = pos.hash;
+		game->moves[game->len++] = legal.moves[index];
+		position_apply(&pos, legal.moves[index]);
+
+		while (c < end && !pdn_space(*c) && *c != '{' && *c != '(') c++;
+	}
+
+	r->at = c - r->data;
+
+	return started || game->fen ? PDN_GAME : PDN_EOF;
+}
+
+/*
+	writes the game as PDN, with the moves wrapped at PDN_LINE columns
+	and the captures with their whole route ("6x15x22")
+*/
+bool
+pdn_write(FILE *f, const PdnGame *game, const char *event){
+
+	static const char *RESULT_TEXT[] = { "*", "1-0", "0-1", "1/2-1/2" };
+
+	char out[PDN_MAX_PLIES * (PDN_TOKEN + 1) + 512];
+	char token[PDN_TOKEN];
+	char notation[4 * (MAX_CAPTURES + 1)];
+	int len = 0, column = 0;
+
+	len += sprintf(out + len, "[Event \"%s\"]\n", event ? event : "?");
+	if (game->fen) {
+		char fen[128];
+		position_to_fen(&(game->start), fen);
+		len += sprintf(out + len, "[FEN \"%s\"]\n", fen);
+	}
+	len += sprintf(out + len, "[Result \"%s\"]\n\n", RESULT_TEXT[game->result]);
+
+	for (int i = 0; i<=game->len; ++i) {
+		int n = 0;
+		// the side to move at the start decides where the move numbers go
+		int ply = i + (game->start.turn == WHITE);
+
+		if (i == game->len)
+			n = sprintf(token, "%s", RESULT_TEXT[game->result]);
+		else {
+			move_format_path(game->moves[i], notation);
+			if (ply % 2 == 0)
+				n = sprintf(token, "%d. %s", ply / 2 + 1, notation);
+			else if (i == 0)
+				n = sprintf(token, "%d... %s", ply / 2 + 1, notation);
+			else
+				n = sprintf(token, "%s", notation);
+		}
+
+		if (column > 0 && column + 1 + n > PDN_LINE) {
+			out[len++] = '\n';
+			column = 0;
+		}
+		else if (column > 0) {
+			out[len++] = ' ';
+			column++;
+		}
+		memcpy(out + len, token, n);
+		len += n;
+		column += n;
+	}
+	len += sprintf(out + len, "\n\n");
+
+	return fwrite(out, 1, len, f) == (size_t)len;
+}
+
+/*
+	checkers pdn <archive> [-o out]
+	replays every game of the archive (no board printing)
+	and writes the good ones to "out" if there is one
+*/
+int
+pdn_main(int argc, char *argv[]){
+
+	if (argc < 2) {
+		printf("usage: checkers pdn <archive> [-o out]\n");
+		return 1;
+	}
+
+	const char *out_path = argc >= 4 && strcmp(argv[2], "-o") == 0 ? argv[3] : NULL;
+	FILE *out = NULL;
+	PdnReader reader;
+	PdnGame *game = malloc(sizeof(PdnGame));
+
+	if (game == NULL) return 1;
+	if (!pdn_open(&reader, argv[1])) {
+		printf("Couldn't open %s\n", argv[1]);
+		free(game);
+		return 1;
+	}
+	if (out_path && (out = fopen(out_path, "w")) == NULL) {
+		printf("Couldn't open %s\n", out_path);
+		pdn_close(&reader);
+		free(game);
+		return 1;
+	}
+
+	uint64_t games = 0, illegal = 0, plies = 0;
+	int results[4] = { 0 };
+	int status;
+	double start = clock_seconds();
+
+	while ((status = pdn_next(&reader, game)) != PDN_EOF) {
+		if (status == PDN_ILLEGAL) {
+			// how far into the archive it went wrong
+			if (illegal < 10)
+				printf("illegal game %llu, ply %d (byte %zu)\n", (unsigned long long)(games + illegal + 1),
+				       game->len + 1, reader.at);
+			illegal++;
+			continue;
+		}
+		games++;
+		plies += game->len;
+		results[game->result]++;
+		if (out) pdn_write(out, game, NULL);
+	}
+
+	double elapsed = clock_seconds() - start;
+
+	printf("%llu games (black %d, white %d, draws %d, unknown %d), %llu illegal, %llu plies\n",
+	       (unsigned long long)games, results[PDN_BLACK_WINS], results[PDN_WHITE_WINS],
+	       results[PDN_DRAW], results[PDN_UNKNOWN], (unsigned long long)illegal,
+	       (unsigned long long)plies);
+	printf("%.1f MB in %.3f s, %.1f MB/s, %.0f games/s\n", reader.len / 1e6, elapsed,
+	       elapsed > 0 ? reader.len / 1e6 / elapsed : 0.0, elapsed > 0 ? games / elapsed : 0.0);
+
+	if (out) fclose(out);
+	pdn_close(&reader);
+	free(game);
+	return illegal ? 1 : 0;
+}
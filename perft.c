@@ -0,0 +1,157 @@
+#include "checkers.h"
+
+#define START_FEN "B:W21,22,23,24,25,26,27,28,29,30,31,32:B1,2,3,4,5,6,7,8,9,10,11,12"
+
+/*
+	published perft numbers for 8x8 checkers (english draughts)
+	counted from the starting position with black to move
+*/
+typedef
+struct {
+	const char *fen;
+	int depth;
+	uint64_t nodes;
+} PerftResult;
+
+const PerftResult PERFT_TABLE[] = {
+	{ START_FEN,  1, 7ull },
+	{ START_FEN,  2, 49ull },
+	{ START_FEN,  3, 302ull },
+	{ START_FEN,  4, 1469ull },
+	{ START_FEN,  5, 7361ull },
+	{ START_FEN,  6, 36768ull },
+	{ START_FEN,  7, 179740ull },
+	{ START_FEN,  8, 845931ull },
+	{ START_FEN,  9, 3963680ull },
+	{ START_FEN, 10, 18391564ull },
+	{ START_FEN, 11, 85242128ull },
+};
+
+#define PERFT_TABLE_LEN (sizeof(PERFT_TABLE) / sizeof(PERFT_TABLE[0]))
+
+/*
+	counts the positions "depth" moves deep
+	the last ply isn't played out, the number of moves is enough there
+*/
+uint64_t
+perft(Position *pos, int depth){
+
+	if (depth == 0) return 1;
+
+	MoveBuf buf;
+	generate_moves(pos, pos->turn, &buf);
+
+	if (depth == 1) return buf.len;
+
+	uint64_t nodes = 0;
+	for (int i = 0; i<buf.len; ++i) {
+		Undo undo;
+		make_move(pos, buf.moves[i], &undo);
+		nodes += perft(pos, depth - 1);
+		unmake_move(pos, buf.moves[i], &undo);
+	}
+
+	return nodes;
+}
+
+/* perft, but prints the count under every move of the root */
+uint64_t
+perft_divide(const Position *pos, int depth){
+
+	MoveBuf buf;
+	uint64_t nodes = 0;
+	char notation[8];
+	Position work = *pos;
+	double start = clock_seconds();
+
+	if (depth < 1) return 1;
+
+	generate_moves(&work, work.turn, &buf);
+
+	for (int i = 0; i<buf.len; ++i) {
+		Undo undo;
+		make_move(&work, buf.moves[i], &undo);
+		uint64_t count = perft(&work, depth - 1);
+		unmake_move(&work, buf.moves[i], &undo);
+		move_format(buf.moves[i], notation);
+		printf("%-6s %llu\n", notation, (unsigned long long)count);
+		nodes += count;
+	}
+
+	STAT_TIME(STAT_TIME_PERFT, start);
+	return nodes;
+}
+
+/* runs the whole table, returns false if any of the counts is off */
+bool
+perft_check(void){
+
+	bool ok = true;
+	uint64_t total = 0;
+	double start = clock_seconds();
+
+	for (size_t i = 0; i<PERFT_TABLE_LEN; ++i) {
+		const PerftResult *r = &(PERFT_TABLE[i]);
+		Position pos;
+
+		if (!position_from_fen(&pos, r->fen)) {
+			printf("bad FEN in the perft table: %s\n", r->fen);
+			ok = false;
+			continue;
+		}
+
+		uint64_t nodes = perft(&pos, r->depth);
+		total += nodes;
+
+		printf("%s depth %2d: %12llu %s\n", r->fen, r->depth, (unsigned long long)nodes,
+		       nodes == r->nodes ? "ok" : "FAILED");
+		if (nodes != r->nodes) {
+			printf("    expected %llu\n", (unsigned long long)r->nodes);
+			ok = false;
+		}
+	}
+
+	double elapsed = clock_seconds() - start;
+	STAT_TIME(STAT_TIME_PERFT, start);
+	printf("%llu nodes in %.3f s (%.0f nodes/s)\n", (unsigned long long)total,
+	       elapsed, elapsed > 0 ? total / elapsed : 0.0);
+
+	return ok;
+}
+
+/*
+	checkers perft <depth> [FEN]   divide from the starting position (or FEN)
+	checkers perft check           compare against the table of known results
+*/
+int
+perft_main(int argc, char *argv[]){
+
+	if (argc >= 2 && strcmp(argv[1], "check") == 0)
+		return perft_check() ? 0 : 1;
+
+	if (argc < 2 || atoi(argv[1]) < 1) {
+		printf("usage: %s perft <depth> [FEN]\n       %s perft check\n", "checkers", "checkers");
+		return 1;
+	}
+
+	Position pos;
+	int depth = atoi(argv[1]);
+
+	if (argc >= 3) {
+		if (!position_from_fen(&pos, argv[2])) {
+			printf("Invalid FEN: %s\n", argv[2]);
+			return 1;
+		}
+	}
+	else
+		position_from_fen(&pos, START_FEN);
+
+	double start = clock_seconds();
+	uint64_t nodes = perft_divide(&pos, depth);
+	double elapsed = clock_seconds() - start;
+
+	printf("\nperft(%d) = %llu\n", depth, (unsigned long long)nodes);
+	printf("%.3f s, %.0f nodes/s\n", elapsed, elapsed > 0 ? nodes / elapsed : 0.0);
+
+	return 0;
+}
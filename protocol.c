@@ -0,0 +1,277 @@
+#include <pthread.h>
+#include <time.h>
+
+#include "checkers.h"
+
+/*
+	a text protocol for driving the engine from another program,
+	in the style of UCI, one command per line on stdin:
+
+		protocol                     -> id lines and "protocolok"
+		isready                      -> "readyok"
+		newgame                      clears the transposition table
+		setoption name <Hash|Threads|Engine|Book|Tablebases|EvalFile> value <v>
+		position startpos|fen <FEN> [moves 11-15 22-18 ...]
+		go [depth N] [nodes N] [movetime ms] [btime ms] [wtime ms]
+		   [binc ms] [winc ms] [movestogo N] [infinite]
+		stop
+		stats                        -> "stats" and the engine statistics as JSON
+		quit
+
+	moves are in square numbers ("11-15", "15x22x29"), "go" prints
+	"info" lines while it searches and "bestmove" at the end
+	the search runs on its own thread, so "stop" and "isready" are
+	answered while it's going
+*/
+
+#define PROTOCOL_LINE 16384
+
+typedef
+struct {
+	Engine engine;
+	Position pos;
+	pthread_t thread;
+	bool searching;		// there is a search thread that hasn't been joined yet
+	atomic_bool done;
+} Protocol;
+
+static void *
+protocol_search(void *arg){
+
+	Protocol *p = arg;
+	char notation[4 * (MAX_CAPTURES + 1)];
+	SearchResult res = search(&(p->engine), &(p->pos));
+
+	if (res.best == MOVE_NONE)
+		printf("bestmove none\n");
+	else {
+		move_format_path(res.best, notation);
+		printf("bestmove %s\n", notation);
+	}
+	fflush(stdout);
+
+	atomic_store(&(p->done), true);
+	return NULL;
+}
+
+/* stops the search if there is one and waits for its thread */
+static void
+protocol_stop(Protocol *p){
+
+	struct timespec ms = { 0, 1000000 };
+
+	if (!p->searching) return;
+
+	// search() clears the flag when it starts, so keep setting it until it's over
+	while (!atomic_load(&(p->done))) {
+		atomic_store(&(p->engine.stop), true);
+		nanosleep(&ms, NULL);
+	}
+
+	pthread_join(p->thread, NULL);
+	p->searching = false;
+}
+
+/* "position startpos|fen <FEN> [moves ...]", returns false if any of it is wrong */
+static bool
+protocol_position(Protocol *p, char *args){
+
+	Position pos;
+	char *moves = strstr(args, "moves");
+	char *tok;
+
+	if (moves) *moves = '\0';
+
+	tok = strtok(args, " \t\r\n");
+	if (tok && strcmp(tok, "startpos") == 0)
+		setup_board(&pos);
+	else if (tok && strcmp(tok, "fen") == 0) {
+		tok = strtok(NULL, " \t\r\n");
+		if (tok == NULL || !position_from_fen(&pos, tok)) return false;
+	}
+	else
+		return false;
+
+	if (moves) {
+		for (tok = strtok(moves + 5, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+			Move m;
+			if (!book_match_move(&pos, tok, &m)) return false;
+			position_apply(&pos, m);
+		}
+	}
+
+	p->pos = pos;
+	return true;
+}
+
+/* turns the "go" arguments into search limits */
+static void
+protocol_go(Protocol *p, char *args){
+
+	SearchLimits *limits = &(p->engine.limits);
+	double time_left = 0, increment = 0;
+	int moves_to_go = 30;
+
+	search_limits_default(limits);
+	limits->verbose = true;
+
+	for (char *tok = strtok(args, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+		char *value = strtok(NULL, " \t\r\n");
+
+		if (strcmp(tok, "infinite") == 0) {
+			// nothing to set, and the next word is another argument
+			if (value == NULL) break;
+			tok = value;
+			value = strtok(NULL, " \t\r\n");
+		}
+		if (value == NULL) break;
+
+		bool mine = (p->pos.turn == BLACK) == (tok[0] == 'b');
+
+		if (strcmp(tok, "depth") == 0)          limits->max_depth = atoi(value);
+		else if (strcmp(tok, "nodes") == 0)     limits->node_limit = strtoull(value, NULL, 10);
+		else if (strcmp(tok, "movetime") == 0)  limits->time_limit = atof(value) / 1000;
+		else if (strcmp(tok, "movestogo") == 0) moves_to_go = atoi(value) > 0 ? atoi(value) : 1;
+		else if ((strcmp(tok, "btime") == 0 || strcmp(tok, "wtime") == 0) && mine)
+			time_left = atof(value) / 1000;
+		else if ((strcmp(tok, "binc") == 0 || strcmp(tok, "winc") == 0) && mine)
+			increment = atof(value) / 1000;
+	}
+
+	// an even share of the clock, but never more than half of what's left
+	if (time_left > 0 && limits->time_limit == 0) {
+		double share = time_left / moves_to_go + increment * 3 / 4;
+		limits->time_limit = share < time_left / 2 ? share : time_left / 2;
+	}
+
+	atomic_store(&(p->done), false);
+	if (pthread_create(&(p->thread), NULL, protocol_search, p) == 0)
+		p->searching = true;
+	else
+		protocol_search(p);
+}
+
+/* "setoption name <name> value <value>" */
+static void
+protocol_option(Protocol *p, char *args){
+
+	char *name = strstr(args, "name ");
+	char *value = strstr(args, "value ");
+
+	if (name == NULL || value == NULL) return;
+	name += 5;
+	value[-1] = '\0';
+	value += 6;
+	value[strcspn(value, "\r\n")] = '\0';
+
+	if (strcmp(name, "Hash") == 0) {
+		if (!tt_init(strtoul(value, NULL, 10)))
+			printf("info string couldn't allocate %s MB\n", value);
+	}
+	else if (strcmp(name, "Threads") == 0) {
+		// engine_init sets everything back, the other options stay as they were
+		int kind = p->engine.kind;
+		bool use_book = p->engine.use_book;
+		uint64_t book_seed = p->engine.book_seed;
+		engine_free(&(p->engine));
+		engine_init(&(p->engine), atoi(value));
+		p->engine.kind = kind;
+		p->engine.use_book = use_book;
+		p->engine.book_seed = book_seed;
+	}
+	else if (strcmp(name, "Engine") == 0) {
+		int kind = engine_kind(value);
+		if (kind < 0)
+			printf("info string unknown engine %s\n", value);
+		else
+			p->engine.kind = kind;
+	}
+	else if (strcmp(name, "Book") == 0)
+		p->engine.use_book = book_open(value);
+	else if (strcmp(name, "Tablebases") == 0)
+		tb_init(value, TB_MAX_PIECES);
+	else if (strcmp(name, "EvalFile") == 0) {
+		if (!nnue_load(value))
+			printf("info string couldn't load the network %s\n", value);
+	}
+	else
+		printf("info string unknown option %s\n", name);
+}
+
+int
+protocol_main(int argc, char *argv[]){
+
+	(void)argc;
+	(void)argv;
+
+	static Protocol p;
+	char line[PROTOCOL_LINE];
+
+	// the other end reads line by line through a pipe
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if (!tt_init(TT_DEFAULT_MB) || !engine_init(&(p.engine), 1)) {
+		printf("info string couldn't set up the engine\n");
+		return 1;
+	}
+	p.engine.book_seed = (uint64_t)time(NULL) | 1;
+	atomic_init(&(p.done), true);
+	setup_board(&(p.pos));
+
+	while (fgets(line, sizeof line, stdin)) {
+
+		char *cmd = line + strspn(line, " \t");
+		size_t len = strcspn(cmd, " \t\r\n");
+		char *args = cmd + len + (cmd[len] != '\0');
+		cmd[len] = '\0';
+
+		if (strcmp(cmd, "protocol") == 0) {
+			printf("id name cheCkers\n");
+			printf("option name Hash type spin default %d\n", TT_DEFAULT_MB);
+			printf("option name Threads type spin default 1 max %d\n", MAX_THREADS);
+			printf("option name Engine type combo default alphabeta var alphabeta var uct var puct\n");
+			printf("option name Book type string\n");
+			printf("option name Tablebases type string\n");
+			printf("option name EvalFile type string\n");
+			printf("protocolok\n");
+		}
+		else if (strcmp(cmd, "isready") == 0)
+			printf("readyok\n");
+		else if (strcmp(cmd, "newgame") == 0) {
+			protocol_stop(&p);
+			tt_clear();
+		}
+		else if (strcmp(cmd, "setoption") == 0) {
+			protocol_stop(&p);
+			protocol_option(&p, args);
+		}
+		else if (strcmp(cmd, "position") == 0) {
+			protocol_stop(&p);
+			if (!protocol_position(&p, args))
+				printf("info string bad position\n");
+		}
+		else if (strcmp(cmd, "go") == 0) {
+			protocol_stop(&p);
+			protocol_go(&p, args);
+		}
+		else if (strcmp(cmd, "stop") == 0)
+			protocol_stop(&p);
+		else if (strcmp(cmd, "stats") == 0) {
+			printf("stats ");
+			stats_json(stdout);
+		}
+		else if (strcmp(cmd, "quit") == 0)
+			break;
+		else if (cmd[0] != '\0')
+			printf("info string unknown command %s\n", cmd);
+	}
+
+	protocol_stop(&p);
+	engine_free(&(p.engine));
+	tt_free();
+	tb_close();
+	book_close();
+	nnue_free();
+
+	return 0;
+}
@@ -0,0 +1,491 @@
+#include <pthread.h>
+
+#include "checkers.h"
+
+/*
+	negamax alpha-beta with iterative deepening
+
+	every iteration is searched in an aspiration window around the
+	score of the previous one, and at the horizon the search keeps
+	going as long as the side to move has to take (captures are forced,
+	so cutting a capture chain in half would give a garbage score)
+*/
+
+#define ASPIRATION_WINDOW 40
+
+/*
+	how often (in nodes) a thread adds to the shared count and looks at the clock
+	the shared count is only for the node limit, it's up to this many nodes
+	behind for every thread, so the info lines add up the threads' own counts
+*/
+#define CHECK_INTERVAL 1024
+
+static bool
+search_stopped(const SearchCtx *ctx){
+	return atomic_load_explicit(&(ctx->engine->stop), memory_order_relaxed);
+}
+
+static bool
+search_should_stop(SearchCtx *ctx){
+
+	Engine *engine = ctx->engine;
+
+	if (search_stopped(ctx)) return true;
+
+	if ((ctx->nodes & (CHECK_INTERVAL - 1)) != 0) return false;
+
+	uint64_t nodes = atomic_fetch_add_explicit(&(engine->nodes), CHECK_INTERVAL, memory_order_relaxed);
+
+	if (engine->limits.node_limit && nodes + CHECK_INTERVAL >= engine->limits.node_limit)
+		atomic_store(&(engine->stop), true);
+	// only the main thread keeps time
+	if (ctx->id == 0 && engine->limits.time_limit > 0 &&
+	    clock_seconds() - engine->start >= engine->limits.time_limit)
+		atomic_store(&(engine->stop), true);
+
+	return search_stopped(ctx);
+}
+
+/*
+	puts the best looking moves to the front:
+	the move from the last iteration's PV, the one the transposition table
+	remembers, then the killers, then by history
+*/
+static void
+order_moves(SearchCtx *ctx, MoveBuf *buf, int ply, const Move *pv_move, const Move *tt_move){
+
+	int scores[MAX_MOVES];
+
+	for (int i = 0; i<buf->len; ++i) {
+		Move m = buf->moves[i];
+		if (pv_move && move_equal(m, *pv_move, false))
+			scores[i] = 1 << 30;
+		else if (tt_move && move_equal(m, *tt_move, true))
+			scores[i] = 1 << 29;
+		else if (MOVE_TAKEN(m))
+			scores[i] = (1 << 28) + bb_popcount(MOVE_TAKEN(m));
+		else if (move_equal(m, ctx->killers[ply][0], false))
+			scores[i] = 1 << 27;
+		else if (move_equal(m, ctx->killers[ply][1], false))
+			scores[i] = (1 << 27) - 1;
+		else
+			scores[i] = ctx->history[MOVE_FROM(m) - 1][MOVE_TO(m) - 1];
+	}
+
+	// insertion sort, the lists are short
+	for (int i = 1; i<buf->len; ++i) {
+		Move m = buf->moves[i];
+		int s = scores[i];
+		int j = i - 1;
+		while (j >= 0 && scores[j] < s) {
+			buf->moves[j + 1] = buf->moves[j];
+			scores[j + 1] = scores[j];
+			j--;
+		}
+		buf->moves[j + 1] = m;
+		scores[j + 1] = s;
+	}
+}
+
+static void
+store_killer(SearchCtx *ctx, int ply, Move m, int depth){
+
+	if (MOVE_TAKEN(m)) return;
+
+	if (!move_equal(m, ctx->killers[ply][0], false)) {
+		ctx->killers[ply][1] = ctx->killers[ply][0];
+		ctx->killers[ply][0] = m;
+	}
+	ctx->history[MOVE_FROM(m) - 1][MOVE_TO(m) - 1] += depth * depth;
+}
+
+static int
+negamax(SearchCtx *ctx, Position *pos, int depth, int alpha, int beta, int ply){
+
+	ctx->nodes++;
+	ctx->pv_len[ply] = 0;
+
+	if (search_should_stop(ctx)) return 0;
+
+	// the tablebases know better than any search
+	uint8_t tb_value;
+	if (ply > 0 && tb_probe(pos, &tb_value)) {
+		ctx->tb_hits++;
+		return tb_score(tb_value, ply);
+	}
+
+	bool capture = taking_available(pos, pos->turn);
+
+	// quiescence: only stop at the horizon when nothing is hanging
+	if ((depth <= 0 && !capture) || ply >= MAX_PLY - 1)
+		return nnue_ready() ? nnue_evaluate(&(ctx->acc[ply]), pos->turn) : evaluate(pos);
+
+	int alpha_orig = alpha;
+	TTEntry entry;
+	Move tt_move = MOVE_NONE;
+
+	if (tt_probe(pos->hash, &entry, &(ctx->tt))) {
+		tt_move = entry.move;
+
+		// the root always gets searched, it has to come up with a move
+		if (ply > 0 && entry.depth >= depth) {
+			int score = tt_score_from(entry.score, ply);
+			if (entry.bound == TT_EXACT ||
+			    (entry.bound == TT_LOWER && score >= beta) ||
+			    (entry.bound == TT_UPPER && score <= alpha)) {
+				STAT_INC(STAT_TT_CUTOFFS);
+				return score;
+			}
+		}
+	}
+
+	MoveBuf buf;
+	generate_moves(pos, pos->turn, &buf);
+
+	// no moves left is a loss, the sooner the worse
+	if (buf.len == 0)
+		return -SCORE_WIN + ply;
+
+	const Move *pv_move = NULL;
+	if (ctx->follow_pv && ply < ctx->prev_pv_len)
+		pv_move = &(ctx->prev_pv[ply]);
+	order_moves(ctx, &buf, ply, pv_move, tt_move ? &tt_move : NULL);
+	if (!pv_move || !move_equal(buf.moves[0], *pv_move, false))
+		ctx->follow_pv = false;
+
+	int best = -SCORE_INF;
+	Move best_move = MOVE_NONE;
+
+	for (int i = 0; i<buf.len; ++i) {
+
+		Undo undo;
+		make_move(pos, buf.moves[i], &undo);
+		if (nnue_ready())
+			nnue_update(&(ctx->acc[ply]), &(ctx->acc[ply + 1]), pos, buf.moves[i], &undo);
+		int score = -negamax(ctx, pos, depth - 1, -beta, -alpha, ply + 1);
+		unmake_move(pos, buf.moves[i], &undo);
+		// only the first move of a node can be on the old PV
+		ctx->follow_pv = false;
+
+		if (search_stopped(ctx)) return 0;
+
+		if (score > best) {
+			best = score;
+			best_move = buf.moves[i];
+
+			// the principal variation is this move followed by the child's
+			ctx->pv[ply][0] = buf.moves[i];
+			memcpy(&(ctx->pv[ply][1]), ctx->pv[ply + 1], ctx->pv_len[ply + 1] * sizeof(Move));
+			ctx->pv_len[ply] = ctx->pv_len[ply + 1] + 1;
+		}
+
+		if (score > alpha) alpha = score;
+
+		if (alpha >= beta) {
+			STAT_INC(STAT_CUTOFFS);
+			STAT_ADD(STAT_FIRST_CUTOFFS, i == 0);
+			store_killer(ctx, ply, buf.moves[i], depth);
+			break;
+		}
+	}
+
+	int bound = best <= alpha_orig ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+	if (bound == TT_UPPER) best_move = MOVE_NONE;
+	tt_store(pos->hash, depth, bound, tt_score_to(best, ply), best_move, &(ctx->tt));
+
+	return best;
+}
+
+/* prints one line per finished iteration of the main thread */
+static void
+search_report(const Engine *engine, const SearchResult *res){
+
+	char notation[4 * (MAX_CAPTURES + 1)];
+	double elapsed = res->elapsed > 0 ? res->elapsed : 1e-9;
+	uint64_t nodes = 0;
+	TTStats tt = { 0 };
+	uint64_t tb_hits = 0;
+
+	for (int i = 0; i<engine->threads; ++i) {
+		nodes += engine->workers[i].nodes;
+		tt_stats_add(&tt, &(engine->workers[i].tt));
+		tb_hits += engine->workers[i].tb_hits;
+	}
+
+	printf("info depth %d score %d nodes %llu time %.3f nps %.0f tthits %.1f%% tbhits %llu pv",
+	       res->depth, res->score, (unsigned long long)nodes,
+	       res->elapsed, nodes / elapsed,
+	       tt.probes ? 100.0 * tt.hits / tt.probes : 0.0, (unsigned long long)tb_hits);
+	for (int i = 0; i<res->pv_len; ++i) {
+		move_format_path(res->pv[i], notation);
+		printf(" %s", notation);
+	}
+	putc('\n', stdout);
+	fflush(stdout);
+}
+
+void
+search_limits_default(SearchLimits *limits){
+	limits->time_limit = 0;
+	limits->node_limit = 0;
+	limits->max_depth = MAX_DEPTH;
+	limits->verbose = false;
+}
+
+/*
+	one thread's iterative deepening, the result ends up in ctx->result
+	it always comes from the last iteration that finished
+	(except for the first one, which is needed to have a move at all)
+
+	lazy SMP: every thread searches the whole tree on its own copy of the
+	position and they help each other through the transposition table,
+	the odd numbered helpers run one ply ahead of the rest to spread them out
+*/
+static void
+search_iterate(SearchCtx *ctx){
+
+	Engine *engine = ctx->engine;
+	Position *pos = &(ctx->pos);
+	SearchResult *res = &(ctx->result);
+	MoveBuf root;
+	bool main_thread = ctx->id == 0;
+
+	stats_thread_start();
+	generate_moves(pos, pos->turn, &root);
+	res->best = root.moves[0];
+
+	if (nnue_ready())
+		nnue_refresh(pos, &(ctx->acc[0]));
+
+	int max_depth = engine->limits.max_depth > 0 && engine->limits.max_depth < MAX_DEPTH ? engine->limits.max_depth : MAX_DEPTH;
+	int prev_score = 0;
+
+	for (int depth = 1 + (ctx->id & 1); depth<=max_depth; ++depth) {
+
+		int alpha = -SCORE_INF, beta = SCORE_INF;
+		int score;
+
+		if (depth >= 3) {
+			alpha = prev_score - ASPIRATION_WINDOW;
+			beta = prev_score + ASPIRATION_WINDOW;
+		}
+
+		for (;;) {
+			ctx->follow_pv = true;
+			score = negamax(ctx, pos, depth, alpha, beta, 0);
+
+			if (search_stopped(ctx)) break;
+
+			// fell out of the window, search again with the window open on that side
+			if (score <= alpha)      alpha = -SCORE_INF;
+			else if (score >= beta)  beta = SCORE_INF;
+			else break;
+		}
+
+		// an unfinished iteration is only worth anything if there is nothing better
+		if (search_stopped(ctx) && (res->depth > 0 || ctx->pv_len[0] == 0)) break;
+
+		prev_score = score;
+		memcpy(ctx->prev_pv, ctx->pv[0], ctx->pv_len[0] * sizeof(Move));
+		ctx->prev_pv_len = ctx->pv_len[0];
+
+		res->depth = depth;
+		res->score = score;
+		res->best = ctx->pv[0][0];
+		res->pv_len = ctx->pv_len[0];
+		memcpy(res->pv, ctx->pv[0], ctx->pv_len[0] * sizeof(Move));
+		res->elapsed = clock_seconds() - engine->start;
+		res->depth_time[depth] = res->elapsed;
+
+		if (!main_thread) continue;
+
+		if (engine->limits.verbose) search_report(engine, res);
+
+		// a forced result doesn't get any better by searching deeper
+		if (score >= SCORE_WIN - MAX_PLY || score <= -SCORE_WIN + MAX_PLY) break;
+		// only one move, nothing to think about
+		if (root.len == 1 && (engine->limits.time_limit > 0 || engine->limits.node_limit)) break;
+		if (search_stopped(ctx)) break;
+	}
+
+	// the counts the search keeps anyway, added once rather than at every node
+	STAT_ADD(STAT_NODES, ctx->nodes);
+	STAT_ADD(STAT_TT_PROBES, ctx->tt.probes);
+	STAT_ADD(STAT_TT_HITS, ctx->tt.hits);
+	STAT_ADD(STAT_TB_HITS, ctx->tb_hits);
+}
+
+static void *
+search_thread(void *arg){
+	search_iterate((SearchCtx *)arg);
+	return NULL;
+}
+
+/* "threads" search threads (the calling thread counts as the first one) */
+bool
+engine_init(Engine *engine, int threads){
+
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+	search_limits_default(&(engine->limits));
+	engine->threads = threads;
+	atomic_init(&(engine->stop), false);
+	atomic_init(&(engine->nodes), 0);
+	engine->workers = calloc(threads, sizeof(SearchCtx));
+	engine->use_book = false;
+	engine->book_seed = 1;
+	engine->kind = ENGINE_ALPHABETA;
+	engine->tree = NULL;
+
+	return engine->workers != NULL;
+}
+
+void
+engine_free(Engine *engine){
+	free(engine->workers);
+	engine->workers = NULL;
+	mcts_free(engine);
+}
+
+/*
+	searches "pos" with all the engine's threads until a limit runs out
+	the move comes from the main thread, the node count from all of them
+*/
+SearchResult
+search(Engine *engine, const Position *pos){
+
+	pthread_t handles[MAX_THREADS];
+	MoveBuf root;
+	SearchResult res;
+
+	engine->start = clock_seconds();
+	STAT_INC(STAT_SEARCHES);
+	atomic_store(&(engine->stop), false);
+	atomic_store(&(engine->nodes), 0);
+
+	generate_moves(pos, pos->turn, &root);
+	if (root.len == 0) {
+		memset(&res, 0, sizeof res);
+		res.score = -SCORE_WIN;
+		return res;
+	}
+
+	memset(&res, 0, sizeof res);
+	if (engine->use_book && book_probe(pos, &(res.best), &(engine->book_seed))) {
+		res.book = true;
+		res.pv[0] = res.best;
+		res.pv_len = 1;
+		res.elapsed = clock_seconds() - engine->start;
+		if (engine->limits.verbose) {
+			char notation[4 * (MAX_CAPTURES + 1)];
+			move_format_path(res.best, notation);
+			printf("info book move %s time %.6f\n", notation, res.elapsed);
+		}
+		return res;
+	}
+
+	if (engine->kind != ENGINE_ALPHABETA)
+		return mcts_search(engine, pos);
+
+	if (!tt_ready()) tt_init(TT_DEFAULT_MB);
+	tt_new_search();
+
+	for (int i = 0; i<engine->threads; ++i) {
+		SearchCtx *ctx = &(engine->workers[i]);
+		memset(ctx, 0, sizeof *ctx);
+		ctx->engine = engine;
+		ctx->id = i;
+		ctx->pos = *pos;
+	}
+
+	int started = 1;
+	for (int i = 1; i<engine->threads; ++i, ++started)
+		if (pthread_create(&(handles[i]), NULL, search_thread, &(engine->workers[i])) != 0)
+			break;
+
+	search_iterate(&(engine->workers[0]));
+
+	atomic_store(&(engine->stop), true);
+	for (int i = 1; i<started; ++i)
+		pthread_join(handles[i], NULL);
+
+	res = engine->workers[0].result;
+	res.nodes = 0;
+	for (int i = 0; i<engine->threads; ++i)
+		res.nodes += engine->workers[i].nodes;
+	res.elapsed = clock_seconds() - engine->start;
+	STAT_TIME(STAT_TIME_SEARCH, engine->start);
+
+	return res;
+}
+
+/* nodes and nodes per second of every thread after a search */
+void
+engine_print_threads(const Engine *engine, const SearchResult *res){
+
+	double elapsed = res->elapsed > 0 ? res->elapsed : 1e-9;
+	TTStats tt = { 0 };
+
+	for (int i = 0; i<engine->threads; ++i) {
+		const SearchCtx *ctx = &(engine->workers[i]);
+		printf("thread %2d: depth %2d, %llu nodes, %.0f nodes/s\n", i, ctx->result.depth,
+		       (unsigned long long)ctx->nodes, ctx->nodes / elapsed);
+		tt_stats_add(&tt, &(ctx->tt));
+	}
+	printf("total: %llu nodes, %.0f nodes/s\n", (unsigned long long)res->nodes, res->nodes / elapsed);
+	tt_print_stats(&tt);
+}
+
+/*
+	checkers smp <depth> [threads] [FEN]
+	searches the same position to a fixed depth with one thread and then
+	with "threads", and compares time to depth and nodes per second
+*/
+int
+smp_main(int argc, char *argv[]){
+
+	if (argc < 2 || atoi(argv[1]) < 1) {
+		printf("usage: checkers smp <depth> [threads] [FEN]\n");
+		return 1;
+	}
+
+	int depth = atoi(argv[1]);
+	int threads = argc >= 3 ? atoi(argv[2]) : 2;
+	Position pos;
+
+	setup_board(&pos);
+	if (argc >= 4 && !position_from_fen(&pos, argv[3])) {
+		printf("Invalid FEN: %s\n", argv[3]);
+		return 1;
+	}
+
+	SearchResult results[2];
+	int counts[2] = { 1, threads };
+
+	for (int run = 0; run<2; ++run) {
+		Engine engine;
+		if (!engine_init(&engine, counts[run])) return 1;
+		engine.limits.max_depth = depth;
+
+		tt_init(TT_DEFAULT_MB);
+		results[run] = search(&engine, &pos);
+
+		printf("%d thread(s): depth %d in %.3f s, %llu nodes, %.0f nodes/s\n", engine.threads,
+		       results[run].depth, results[run].elapsed, (unsigned long long)results[run].nodes,
+		       results[run].nodes / (results[run].elapsed > 0 ? results[run].elapsed : 1e-9));
+		engine_print_threads(&engine, &(results[run]));
+		engine_free(&engine);
+	}
+
+	double nps[2];
+	for (int run = 0; run<2; ++run)
+		nps[run] = results[run].nodes / (results[run].elapsed > 0 ? results[run].elapsed : 1e-9);
+
+	printf("time to depth speedup: %.2fx, nps speedup: %.2fx\n",
+	       results[1].elapsed > 0 ? results[0].elapsed / results[1].elapsed : 0.0,
+	       nps[0] > 0 ? nps[1] / nps[0] : 0.0);
+
+	tt_free();
+	return 0;
+}
@@ -0,0 +1,267 @@
+#include <pthread.h>
+
+#include "checkers.h"
+
+/*
+	engine against engine games without the board on the screen
+
+	every worker thread plays whole games with its own single threaded
+	engine (they all share the transposition table) and writes each
+	finished game as one line in the book builder's move text format:
+
+		1. 11-15 {0} 23-19 {-4} 2. 8-11 {10} ... 1-0
+
+	the number after a move is the score the engine gave it, from the
+	side that played it, the moves of the random opening don't have one
+	the records are built in buffers the workers own, so a game doesn't
+	allocate anything, and they go to the file one line at a time
+*/
+
+// how many engine moves in a row have to agree before a game is adjudicated
+#define ADJUDICATE_PLIES 4
+
+typedef
+struct {
+	int games;
+	int workers;
+	SearchLimits limits;
+	int random_plies;
+	int max_plies;
+	int adjudicate;		// score for adjudicating a win, 0 to play games out
+	uint64_t seed;
+	FILE *out;
+} SelfplayConfig;
+
+typedef
+struct {
+	const SelfplayConfig *config;
+	atomic_int *next_game;
+	pthread_mutex_t *out_lock;
+	int results[3];		// black wins, white wins, draws
+	uint64_t plies;
+	uint64_t nodes;
+} SelfplayWorker;
+
+static uint64_t
+selfplay_random(uint64_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+/*
+	plays game number "game" and writes its record into "line"
+	returns the winner, -1 for a draw
+*/
+static int
+selfplay_game(SelfplayWorker *w, Engine *engine, int game, char *line, int *plies){
+
+	const SelfplayConfig *config = w->config;
+	Position pos;
+	MoveBuf buf;
+	char notation[4 * (MAX_CAPTURES + 1)];
+	int len = 0;
+	int ply = 0;
+	int winner = -1;
+	int streak = 0;
+	COLOR leader = BLACK;
+
+	// every game gets its own stream, so the openings don't depend on the workers
+	uint64_t state = config->seed + (uint64_t)game * 0x9E3779B97F4A7C15ull;
+	state = state ? state : 1;
+
+	setup_board(&pos);
+	line[0] = '\0';
+
+	for (ply = 0; ply<config->max_plies; ++ply) {
+
+		generate_moves(&pos, pos.turn, &buf);
+		if (buf.len == 0) {
+			winner = !pos.turn;
+			break;
+		}
+
+		uint8_t value;
+		if (tb_probe(&pos, &value)) {
+			winner = TB_IS_WIN(value) ? (int)pos.turn : TB_IS_LOSS(value) ? (int)!pos.turn : -1;
+			break;
+		}
+
+		Move m;
+		bool scored = ply >= config->random_plies;
+		int score = 0;
+
+		if (!scored)
+			m = buf.moves[selfplay_random(&state) % buf.len];
+		else {
+			SearchResult res = search(engine, &pos);
+			m = res.best;
+			score = res.score;
+			w->nodes += res.nodes;
+		}
+
+		if (pos.turn == BLACK)
+			len += snprintf(line + len, SELFPLAY_LINE - len, "%d. ", ply / 2 + 1);
+		move_format_path(m, notation);
+		len += snprintf(line + len, SELFPLAY_LINE - len, "%s ", notation);
+		if (scored)
+			len += snprintf(line + len, SELFPLAY_LINE - len, "{%d} ", score);
+
+		position_apply(&pos, m);
+
+		if (!scored || config->adjudicate == 0) continue;
+
+		// both engines have to agree on who's winning for a few moves
+		COLOR ahead = score >= 0 ? !pos.turn : pos.turn;
+		if (abs(score) >= config->adjudicate) {
+			streak = streak > 0 && ahead == leader ? streak + 1 : 1;
+			leader = ahead;
+		}
+		else
+			streak = 0;
+		if (streak >= ADJUDICATE_PLIES || abs(score) >= SCORE_DECISIVE) {
+			winner = ahead;
+			ply++;
+			break;
+		}
+	}
+
+	snprintf(line + len, SELFPLAY_LINE - len, "%s\n",
+	         winner == BLACK ? "1-0" : winner == WHITE ? "0-1" : "1/2-1/2");
+	*plies = ply;
+
+	return winner;
+}
+
+static void *
+selfplay_worker(void *arg){
+
+	SelfplayWorker *w = arg;
+	const SelfplayConfig *config = w->config;
+	char line[SELFPLAY_LINE];
+	Engine engine;
+
+	stats_thread_start();
+	if (!engine_init(&engine, 1)) return NULL;
+	engine.limits = config->limits;
+
+	for (;;) {
+		int game = atomic_fetch_add(w->next_game, 1);
+		if (game >= config->games) break;
+
+		int plies;
+		int winner = selfplay_game(w, &engine, game, line, &plies);
+
+		w->results[winner < 0 ? 2 : winner]++;
+		w->plies += plies;
+
+		pthread_mutex_lock(w->out_lock);
+		fputs(line, config->out);
+		pthread_mutex_unlock(w->out_lock);
+	}
+
+	engine_free(&engine);
+	return NULL;
+}
+
+/*
+	checkers selfplay <out> <games> [-w workers] [-d depth] [-n nodes] [-t seconds]
+	                  [-r random plies] [-s seed] [-a adjudicate score] [-l max plies]
+	                  [-m hash MB] [-e tablebase dir]
+	"-" as <out> writes the games to stdout
+*/
+int
+selfplay_main(int argc, char *argv[]){
+
+	SelfplayConfig config;
+	size_t hash_mb = TT_DEFAULT_MB;
+
+	if (argc < 3 || atoi(argv[2]) < 1) {
+		printf("usage: checkers selfplay <out> <games> [-w workers] [-d depth] [-n nodes] [-t seconds]\n"
+		       "                         [-r random plies] [-s seed] [-a adjudicate score] [-l max plies]\n"
+		       "                         [-m hash MB] [-e tablebase dir]\n");
+		return 1;
+	}
+
+	config.games = atoi(argv[2]);
+	config.workers = 1;
+	search_limits_default(&(config.limits));
+	config.limits.max_depth = 6;
+	config.random_plies = 4;
+	config.max_plies = 200;
+	config.adjudicate = 400;
+	config.seed = 1;
+
+	for (int i = 3; i + 1<argc; ++i) {
+		if (strcmp(argv[i], "-w") == 0)      config.workers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0) config.limits.max_depth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0) config.limits.node_limit = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-t") == 0) config.limits.time_limit = atof(argv[++i]);
+		else if (strcmp(argv[i], "-r") == 0) config.random_plies = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-s") == 0) config.seed = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-a") == 0) config.adjudicate = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-l") == 0) config.max_plies = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0) hash_mb = strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-e") == 0) tb_init(argv[++i], TB_MAX_PIECES);
+	}
+
+	if (config.workers < 1) config.workers = 1;
+	if (config.workers > MAX_THREADS) config.workers = MAX_THREADS;
+	if (config.max_plies < 1 || config.max_plies > SELFPLAY_MAX_PLIES) config.max_plies = SELFPLAY_MAX_PLIES;
+
+	config.out = strcmp(argv[1], "-") == 0 ? stdout : fopen(argv[1], "w");
+	if (config.out == NULL) {
+		printf("Couldn't open %s\n", argv[1]);
+		return 1;
+	}
+
+	zobrist_init();
+	if (!tt_init(hash_mb)) {
+		printf("Couldn't allocate the transposition table\n");
+		return 1;
+	}
+
+	pthread_t handles[MAX_THREADS];
+	SelfplayWorker workers[MAX_THREADS];
+	pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+	atomic_int next_game;
+	atomic_init(&next_game, 0);
+
+	double start = clock_seconds();
+
+	int started = 0;
+	for (int i = 0; i<config.workers; ++i) {
+		memset(&(workers[i]), 0, sizeof workers[i]);
+		workers[i].config = &config;
+		workers[i].next_game = &next_game;
+		workers[i].out_lock = &out_lock;
+		if (pthread_create(&(handles[i]), NULL, selfplay_worker, &(workers[i])) != 0)
+			break;
+		started++;
+	}
+
+	int results[3] = { 0 };
+	uint64_t plies = 0, nodes = 0;
+	for (int i = 0; i<started; ++i) {
+		pthread_join(handles[i], NULL);
+		for (int r = 0; r<3; ++r) results[r] += workers[i].results[r];
+		plies += workers[i].plies;
+		nodes += workers[i].nodes;
+	}
+
+	double elapsed = clock_seconds() - start;
+	int games = results[0] + results[1] + results[2];
+
+	if (config.out != stdout) fclose(config.out);
+
+	FILE *report = config.out == stdout ? stderr : stdout;
+	fprintf(report, "%d games (black %d, white %d, draws %d), %llu plies in %.2f s\n",
+	        games, results[BLACK], results[WHITE], results[2], (unsigned long long)plies, elapsed);
+	fprintf(report, "%.0f games/min, %.0f nodes/s over %d worker(s)\n",
+	        elapsed > 0 ? games * 60 / elapsed : 0.0, elapsed > 0 ? nodes / elapsed : 0.0, started);
+
+	tt_free();
+	tb_close();
+	return games == config.games ? 0 : 1;
+}
@@ -0,0 +1,968 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "checkers.h"
+
+/*
+	many human against engine games in one process
+
+	one thread runs an epoll loop over the listening socket and every
+	connection, each connection is one game, and the games live in a pool
+	that's allocated when the server starts: a game slot has its GameCtx
+	and fixed input and output buffers, so nothing is allocated per move
+	(the moves are checked against the GameCtx's legal move cache, and
+	the game record isn't kept)
+
+	the engine's moves are searched by a pool of worker threads, every one
+	with its own single threaded engine (the transposition table is shared)
+	a game waiting for the engine goes to the back of one queue, and a game
+	is in there at most once, so the games take turns whatever their clients
+	do, every game also has a budget of engine time, and a move gets an even
+	share of what's left of it (but never more than the move time)
+
+	the protocol is one line per command and per answer:
+
+		hello <game>                 when the connection is accepted
+		                             ("busy" and the connection is closed if the pool is full)
+		new [black|white]            -> "new", the side the human plays (black moves first)
+		move 11-15                   -> "engine 22-18" or "illegal 11-15"
+		                             (captures can have all their squares, "15x22x29")
+		fen                          -> "fen <FEN>"
+		moves                        -> "moves 11-15 11-16 ..."
+		status                       -> "status games <n> queued <n> searches <n>"
+		quit
+
+	and "gameover 1-0|0-1|1/2-1/2" when a move ends the game
+	commands that come in while the engine is thinking wait for its move
+*/
+
+#define SERVER_PORT      7777
+#define SERVER_LINE      128
+#define SERVER_OUT       1024
+#define SERVER_MAX_PLIES 400
+#define SERVER_EVENTS    256
+
+typedef struct server_game ServerGame;
+
+struct server_game {
+	GameCtx game;
+	int fd;			// -1 while the slot is free
+	int id;
+	COLOR human;
+	int plies;
+	bool over;
+	bool searching;		// in the run queue or being searched
+	bool closing;		// the client left while the engine was thinking
+	double budget;		// the engine time left for this game
+	double queued;		// when it went into the run queue
+	SearchLimits limits;
+	SearchResult result;
+	char in[SERVER_LINE];
+	int in_len;
+	char out[SERVER_OUT];
+	int out_len;
+	uint32_t events;	// what epoll is watching for
+	ServerGame *next;	// in the free list, the run queue or the done queue
+};
+
+typedef
+struct {
+	int port;
+	int max_games;
+	int workers;
+	double move_time;
+	double budget;
+	int max_depth;
+	uint64_t node_limit;
+} ServerConfig;
+
+typedef
+struct {
+	const ServerConfig *config;
+	ServerGame *games;
+	ServerGame *free_list;
+	ServerGame *released;	// freed during this round of events, see server_release
+	int epoll;
+	int listener;
+	int wakeup;		// an eventfd, the workers ring it when a search is done
+	int active;
+
+	// everything below is shared with the workers
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	ServerGame *run_head, *run_tail;
+	ServerGame *done_head, *done_tail;
+	int queued;
+	bool shutdown;
+	uint64_t searches;
+	double search_time;
+	double wait_time;
+	double wait_max;
+} Server;
+
+typedef
+struct {
+	Server *server;
+	Engine engine;
+	pthread_t thread;
+} ServerWorker;
+
+// what epoll's data points at for the two descriptors that aren't games
+static char EPOLL_LISTENER, EPOLL_WAKEUP;
+
+static volatile sig_atomic_t server_interrupted = 0;
+
+static void
+server_signal(int sig){
+	(void)sig;
+	server_interrupted = 1;
+}
+
+/* as many descriptors as the hard limit allows, for thousands of sockets */
+static void
+raise_fd_limit(void){
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+static bool
+set_nonblocking(int fd){
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void
+queue_push(ServerGame **head, ServerGame **tail, ServerGame *g){
+	g->next = NULL;
+	if (*tail) (*tail)->next = g;
+	else       *head = g;
+	*tail = g;
+}
+
+static ServerGame *
+queue_pop(ServerGame **head, ServerGame **tail){
+	ServerGame *g = *head;
+	if (g) {
+		*head = g->next;
+		if (*head == NULL) *tail = NULL;
+	}
+	return g;
+}
+
+/* the searches, one game from the front of the run queue at a time */
+static void *
+server_worker(void *arg){
+
+	ServerWorker *w = arg;
+	Server *s = w->server;
+
+	stats_thread_start();
+
+	for (;;) {
+		pthread_mutex_lock(&(s->lock));
+		while (s->run_head == NULL && !s->shutdown)
+			pthread_cond_wait(&(s->work), &(s->lock));
+		ServerGame *g = queue_pop(&(s->run_head), &(s->run_tail));
+		if (g) s->queued--;
+		pthread_mutex_unlock(&(s->lock));
+
+		if (g == NULL) break;
+
+		double waited = clock_seconds() - g->queued;
+		w->engine.limits = g->limits;
+		g->result = search(&(w->engine), &(g->game.pos));
+
+		pthread_mutex_lock(&(s->lock));
+		queue_push(&(s->done_head), &(s->done_tail), g);
+		s->searches++;
+		s->search_time += g->result.elapsed;
+		s->wait_time += waited;
+		if (waited > s->wait_max) s->wait_max = waited;
+		pthread_mutex_unlock(&(s->lock));
+
+		uint64_t one = 1;
+		if (write(s->wakeup, &one, sizeof one) < 0) {}
+	}
+
+	return NULL;
+}
+
+/*
+	input while there's room for it (a client that keeps talking while the
+	engine thinks fills its buffer and then waits), output while there's some
+*/
+static void
+server_watch(Server *s, ServerGame *g){
+
+	uint32_t events = (g->in_len < SERVER_LINE ? EPOLLIN : 0) | (g->out_len > 0 ? EPOLLOUT : 0);
+
+	if (events == g->events) return;
+
+	struct epoll_event ev = { .events = events, .data.ptr = g };
+	epoll_ctl(s->epoll, EPOLL_CTL_MOD, g->fd, &ev);
+	g->events = events;
+}
+
+/*
+	puts the slot back, but only for the next round of events: one that's
+	still waiting in this round could be about the connection it just had
+	and would go to a new one that got the slot
+*/
+static void
+server_release(Server *s, ServerGame *g){
+	g->next = s->released;
+	s->released = g;
+}
+
+static void
+server_close(Server *s, ServerGame *g){
+
+	epoll_ctl(s->epoll, EPOLL_CTL_DEL, g->fd, NULL);
+	close(g->fd);
+	g->fd = -1;
+	s->active--;
+
+	// a worker still has it, the slot is freed when its search comes back
+	if (g->searching) {
+		g->closing = true;
+		return;
+	}
+	server_release(s, g);
+}
+
+/* writes what it can of the output, returns false if the connection is gone */
+static bool
+server_flush(Server *s, ServerGame *g){
+
+	int at = 0;
+
+	while (at < g->out_len) {
+		ssize_t n = send(g->fd, g->out + at, g->out_len - at, MSG_NOSIGNAL);
+		if (n > 0) {
+			at += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		server_close(s, g);
+		return false;
+	}
+
+	memmove(g->out, g->out + at, g->out_len - at);
+	g->out_len -= at;
+
+	server_watch(s, g);
+	return true;
+}
+
+/* one line of output, a client that doesn't read its answers gets dropped */
+static bool
+server_send(Server *s, ServerGame *g, const char *format, ...){
+
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(g->out + g->out_len, SERVER_OUT - g->out_len, format, args);
+	va_end(args);
+
+	if (n < 0 || n >= SERVER_OUT - g->out_len) {
+		server_close(s, g);
+		return false;
+	}
+	g->out_len += n;
+	return server_flush(s, g);
+}
+
+static void
+server_new_game(ServerGame *g, COLOR human, double budget){
+	setup_board(&(g->game.pos));
+	g->game.legal.valid = false;
+	g->game.selected_piece = 0;
+	g->human = human;
+	g->plies = 0;
+	g->over = false;
+	g->budget = budget;
+}
+
+/* hands the game to the workers, with its share of its time budget */
+static void
+server_queue_search(Server *s, ServerGame *g){
+
+	const ServerConfig *config = s->config;
+	SearchLimits *limits = &(g->limits);
+
+	search_limits_default(limits);
+	limits->max_depth = config->max_depth;
+	limits->node_limit = config->node_limit;
+
+	// an even share of the budget over the moves a game usually has left
+	int moves_left = (SERVER_MAX_PLIES / 4 - g->plies / 2);
+	double share = g->budget / (moves_left > 10 ? moves_left : 10);
+	limits->time_limit = share < config->move_time ? share : config->move_time;
+	// out of time, it has to move anyway
+	if (limits->time_limit < 0.001) {
+		limits->time_limit = 0.001;
+		limits->max_depth = 1;
+	}
+
+	g->searching = true;
+	g->queued = clock_seconds();
+
+	pthread_mutex_lock(&(s->lock));
+	queue_push(&(s->run_head), &(s->run_tail), g);
+	s->queued++;
+	pthread_cond_signal(&(s->work));
+	pthread_mutex_unlock(&(s->lock));
+}
+
+/* plays "m" in the game, returns false if the connection went away */
+static bool
+server_play(Server *s, ServerGame *g, Move m){
+
+	position_apply(&(g->game.pos), m);
+	g->plies++;
+
+	const LegalCache *legal = legal_moves(&(g->game));
+	if (legal->moves.len == 0) {
+		g->over = true;
+		return server_send(s, g, "gameover %s\n", g->game.pos.turn == WHITE ? "1-0" : "0-1");
+	}
+	if (g->plies >= SERVER_MAX_PLIES) {
+		g->over = true;
+		return server_send(s, g, "gameover 1/2-1/2\n");
+	}
+
+	if (g->game.pos.turn != g->human)
+		server_queue_search(s, g);
+	return true;
+}
+
+/* the move "text" is in "moves", with all its squares or just the first and the last */
+static bool
+server_match_move(const MoveBuf *moves, const char *text, Move *m){
+
+	char path[4 * (MAX_CAPTURES + 1)];
+	int found = -1;
+
+	for (int i = 0; i<moves->len; ++i) {
+		move_format_path(moves->moves[i], path);
+		if (strcmp(path, text) == 0) {
+			*m = moves->moves[i];
+			return true;
+		}
+		move_format(moves->moves[i], path);
+		if (found < 0 && strcmp(path, text) == 0)
+			found = i;
+	}
+
+	if (found < 0) return false;
+	*m = moves->moves[found];
+	return true;
+}
+
+/* one command, returns false if the connection went away */
+static bool
+server_command(Server *s, ServerGame *g, char *line){
+
+	char *cmd = strtok(line, " \t\r");
+	char *arg = strtok(NULL, " \t\r");
+	char text[SERVER_OUT];
+
+	if (cmd == NULL)
+		return true;
+
+	if (strcmp(cmd, "move") == 0) {
+		Move m;
+		if (g->over || g->game.pos.turn != g->human || arg == NULL ||
+		    !server_match_move(&(legal_moves(&(g->game))->moves), arg, &m))
+			return server_send(s, g, "illegal %s\n", arg ? arg : "");
+		return server_play(s, g, m);
+	}
+	if (strcmp(cmd, "new") == 0) {
+		server_new_game(g, arg && strcmp(arg, "white") == 0 ? WHITE : BLACK, s->config->budget);
+		if (!server_send(s, g, "new\n")) return false;
+		if (g->human == WHITE) server_queue_search(s, g);
+		return true;
+	}
+	if (strcmp(cmd, "fen") == 0) {
+		position_to_fen(&(g->game.pos), text);
+		return server_send(s, g, "fen %s\n", text);
+	}
+	if (strcmp(cmd, "moves") == 0) {
+		const LegalCache *legal = legal_moves(&(g->game));
+		int len = sprintf(text, "moves");
+		for (int i = 0; i<legal->moves.len && len < SERVER_OUT - 4 * (MAX_CAPTURES + 2); ++i) {
+			text[len++] = ' ';
+			move_format_path(legal->moves.moves[i], text + len);
+			len += strlen(text + len);
+		}
+		return server_send(s, g, "%s\n", text);
+	}
+	if (strcmp(cmd, "status") == 0) {
+		pthread_mutex_lock(&(s->lock));
+		int queued = s->queued;
+		uint64_t searches = s->searches;
+		pthread_mutex_unlock(&(s->lock));
+		return server_send(s, g, "status games %d queued %d searches %llu\n",
+		                   s->active, queued, (unsigned long long)searches);
+	}
+	if (strcmp(cmd, "quit") == 0) {
+		server_close(s, g);
+		return false;
+	}
+
+	return server_send(s, g, "error unknown command %s\n", cmd);
+}
+
+/* runs the complete lines in the input, until the engine has to think */
+static void
+server_process(Server *s, ServerGame *g){
+
+	while (!g->searching) {
+		char *end = memchr(g->in, '\n', g->in_len);
+
+		if (end == NULL) {
+			if (g->in_len == SERVER_LINE) {
+				g->in_len = 0;
+				server_send(s, g, "error line too long\n");
+			}
+			return;
+		}
+
+		*end = '\0';
+		int used = end - g->in + 1;
+		bool open = server_command(s, g, g->in);
+		if (!open) return;
+
+		memmove(g->in, g->in + used, g->in_len - used);
+		g->in_len -= used;
+	}
+}
+
+static void
+server_read(Server *s, ServerGame *g){
+
+	for (;;) {
+		if (g->in_len == SERVER_LINE) {
+			if (g->searching) break;
+			server_process(s, g);
+			if (g->fd < 0) return;
+			if (g->in_len == SERVER_LINE) break;
+			continue;
+		}
+
+		ssize_t n = recv(g->fd, g->in + g->in_len, SERVER_LINE - g->in_len, 0);
+		if (n > 0) {
+			g->in_len += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		server_close(s, g);
+		return;
+	}
+
+	server_process(s, g);
+	if (g->fd >= 0) server_watch(s, g);
+}
+
+static void
+server_accept(Server *s){
+
+	for (;;) {
+		int fd = accept(s->listener, NULL, NULL);
+		if (fd < 0) return;
+
+		ServerGame *g = s->free_list;
+		if (g == NULL) {
+			send(fd, "busy\n", 5, MSG_NOSIGNAL);
+			close(fd);
+			continue;
+		}
+
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+		if (!set_nonblocking(fd)) {
+			close(fd);
+			continue;
+		}
+
+		s->free_list = g->next;
+		g->fd = fd;
+		g->in_len = 0;
+		g->out_len = 0;
+		g->events = EPOLLIN;
+		g->searching = false;
+		g->closing = false;
+		server_new_game(g, BLACK, s->config->budget);
+
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = g };
+		if (epoll_ctl(s->epoll, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			close(fd);
+			g->fd = -1;
+			g->next = s->free_list;
+			s->free_list = g;
+			continue;
+		}
+		s->active++;
+		server_send(s, g, "hello %d\n", g->id);
+	}
+}
+
+/* the engine's moves the workers came up with */
+static void
+server_done(Server *s){
+
+	uint64_t count;
+	if (read(s->wakeup, &count, sizeof count) < 0) {}
+
+	pthread_mutex_lock(&(s->lock));
+	ServerGame *done = s->done_head;
+	s->done_head = s->done_tail = NULL;
+	pthread_mutex_unlock(&(s->lock));
+
+	while (done) {
+		ServerGame *g = done;
+		char notation[4 * (MAX_CAPTURES + 1)];
+		done = done->next;
+
+		g->searching = false;
+		if (g->closing) {
+			g->closing = false;
+			server_release(s, g);
+			continue;
+		}
+
+		g->budget -= g->result.elapsed;
+		move_format_path(g->result.best, notation);
+		if (!server_send(s, g, "engine %s\n", notation)) continue;
+		if (!server_play(s, g, g->result.best)) continue;
+		server_process(s, g);
+		if (g->fd >= 0) server_watch(s, g);
+	}
+}
+
+static bool
+server_listen(Server *s, int port){
+
+	struct sockaddr_in addr;
+	int one = 1;
+
+	s->listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (s->listener < 0) return false;
+	setsockopt(s->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	return bind(s->listener, (struct sockaddr *)&addr, sizeof addr) == 0 &&
+	       listen(s->listener, SOMAXCONN) == 0 && set_nonblocking(s->listener);
+}
+
+/*
+	checkers server [-p port] [-g games] [-w workers] [-t seconds per move]
+	                [-b seconds per game] [-d depth] [-n nodes] [-m hash MB]
+	listens on localhost until it gets SIGINT or SIGTERM
+*/
+int
+server_main(int argc, char *argv[]){
+
+	ServerConfig config = { SERVER_PORT, 1024, 2, 0.1, 30.0, MAX_DEPTH, 0 };
+	size_t hash_mb = TT_DEFAULT_MB;
+
+	for (int i = 1; i<argc; ++i) {
+		if (i + 1 >= argc) {
+			printf("usage: checkers server [-p port] [-g games] [-w workers] [-t seconds per move]\n"
+			       "                       [-b seconds per game] [-d depth] [-n nodes] [-m hash MB]\n");
+			return 1;
+		}
+		if (strcmp(argv[i], "-p") == 0)      config.port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-g") == 0) config.max_games = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-w") == 0) config.workers = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0) config.move_time = atof(argv[++i]);
+		else if (strcmp(argv[i], "-b") == 0) config.budget = atof(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0) config.max_depth = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0) config.node_limit = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-m") == 0) hash_mb = strtoul(argv[++i], NULL, 10);
+		else i++;
+	}
+	if (config.max_games < 1) config.max_games = 1;
+	if (config.workers < 1) config.workers = 1;
+	if (config.workers > MAX_THREADS) config.workers = MAX_THREADS;
+
+	static Server s;
+	s.config = &config;
+	pthread_mutex_init(&(s.lock), NULL);
+	pthread_cond_init(&(s.work), NULL);
+
+	raise_fd_limit();
+	zobrist_init();
+	s.games = calloc(config.max_games, sizeof(ServerGame));
+	if (s.games == NULL || !tt_init(hash_mb)) {
+		printf("Couldn't allocate %d games\n", config.max_games);
+		return 1;
+	}
+	for (int i = config.max_games - 1; i>=0; --i) {
+		s.games[i].id = i;
+		s.games[i].fd = -1;
+		s.games[i].next = s.free_list;
+		s.free_list = &(s.games[i]);
+	}
+
+	s.epoll = epoll_create1(0);
+	s.wakeup = eventfd(0, EFD_NONBLOCK);
+	if (s.epoll < 0 || s.wakeup < 0 || !server_listen(&s, config.port)) {
+		printf("Couldn't listen on port %d\n", config.port);
+		return 1;
+	}
+
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &EPOLL_LISTENER };
+	epoll_ctl(s.epoll, EPOLL_CTL_ADD, s.listener, &ev);
+	ev.data.ptr = &EPOLL_WAKEUP;
+	epoll_ctl(s.epoll, EPOLL_CTL_ADD, s.wakeup, &ev);
+
+	ServerWorker workers[MAX_THREADS];
+	int started = 0;
+	for (int i = 0; i<config.workers; ++i) {
+		workers[i].server = &s;
+		if (!engine_init(&(workers[i].engine), 1)) break;
+		if (pthread_create(&(workers[i].thread), NULL, server_worker, &(workers[i])) != 0) {
+			engine_free(&(workers[i].engine));
+			break;
+		}
+		started++;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = server_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("listening on 127.0.0.1:%d, %d games, %d worker(s)\n", config.port, config.max_games, started);
+	fflush(stdout);
+
+	double start = clock_seconds();
+	uint64_t connections = 0;
+	struct epoll_event events[SERVER_EVENTS];
+
+	while (!server_interrupted) {
+		int n = epoll_wait(s.epoll, events, SERVER_EVENTS, -1);
+
+		for (int i = 0; i<n; ++i) {
+			void *ptr = events[i].data.ptr;
+
+			if (ptr == &EPOLL_LISTENER) {
+				int before = s.active;
+				server_accept(&s);
+				connections += s.active > before ? s.active - before : 0;
+			}
+			else if (ptr == &EPOLL_WAKEUP)
+				server_done(&s);
+			else {
+				ServerGame *g = ptr;
+				// it may have been closed by an earlier event of this round
+				if (g->fd < 0) continue;
+				if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+					server_close(&s, g);
+					continue;
+				}
+				if ((events[i].events & EPOLLOUT) && !server_flush(&s, g)) continue;
+				if (events[i].events & EPOLLIN) server_read(&s, g);
+			}
+		}
+
+		// no event of this round is left that could be about the slots it freed
+		while (s.released) {
+			ServerGame *g = s.released;
+			s.released = g->next;
+			g->next = s.free_list;
+			s.free_list = g;
+		}
+	}
+
+	pthread_mutex_lock(&(s.lock));
+	s.shutdown = true;
+	pthread_cond_broadcast(&(s.work));
+	pthread_mutex_unlock(&(s.lock));
+	for (int i = 0; i<started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		engine_free(&(workers[i].engine));
+	}
+
+	double elapsed = clock_seconds() - start;
+	printf("%llu connections, %llu searches in %.1f s (%.0f/s), %.1f ms per search, "
+	       "queue wait %.1f ms average, %.1f ms at most\n",
+	       (unsigned long long)connections, (unsigned long long)s.searches, elapsed,
+	       elapsed > 0 ? s.searches / elapsed : 0.0,
+	       s.searches ? 1000 * s.search_time / s.searches : 0.0,
+	       s.searches ? 1000 * s.wait_time / s.searches : 0.0, 1000 * s.wait_max);
+
+	for (int i = 0; i<config.max_games; ++i)
+		if (s.games[i].fd >= 0) close(s.games[i].fd);
+	close(s.listener);
+	close(s.wakeup);
+	close(s.epoll);
+	free(s.games);
+	tt_free();
+	return 0;
+}
+
+/*
+	the load generator: "connections" clients on one epoll loop, each plays
+	"games" games against the server with random moves, and the time from
+	a move going out to the engine's answer coming back is measured
+*/
+
+#define LOADGEN_BUCKETS 10000	// one per millisecond, the last one is everything slower
+
+typedef
+struct {
+	int fd;
+	Position pos;
+	int plies;
+	int games_left;
+	uint64_t rng;
+	double sent;
+	char in[SERVER_LINE];
+	int in_len;
+} LoadConn;
+
+typedef
+struct {
+	uint64_t games;
+	uint64_t moves;
+	uint64_t errors;
+	uint64_t results[3];	// black wins, white wins, draws
+	double latency_total;
+	double latency_max;
+	uint32_t latency[LOADGEN_BUCKETS];
+} LoadStats;
+
+static uint64_t
+loadgen_random(uint64_t *state){
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static bool
+loadgen_send(LoadConn *c, const char *line){
+	size_t len = strlen(line);
+	return send(c->fd, line, len, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+/* a random legal move, or nothing if the game is over */
+static bool
+loadgen_move(LoadConn *c){
+
+	MoveBuf buf;
+	char line[SERVER_LINE];
+
+	generate_moves(&(c->pos), c->pos.turn, &buf);
+	if (buf.len == 0 || c->plies >= SERVER_MAX_PLIES) return true;
+
+	Move m = buf.moves[loadgen_random(&(c->rng)) % buf.len];
+	strcpy(line, "move ");
+	move_format_path(m, line + 5);
+	strcat(line, "\n");
+
+	position_apply(&(c->pos), m);
+	c->plies++;
+	c->sent = clock_seconds();
+	return loadgen_send(c, line);
+}
+
+/* one line from the server, returns false when the connection is done */
+static bool
+loadgen_line(LoadConn *c, LoadStats *st, char *line){
+
+	if (strncmp(line, "hello", 5) == 0 || strncmp(line, "new", 3) == 0) {
+		if (line[0] == 'h') return loadgen_send(c, "new black\n");
+		setup_board(&(c->pos));
+		c->plies = 0;
+		return loadgen_move(c);
+	}
+
+	if (strncmp(line, "engine ", 7) == 0) {
+		Move m;
+		double latency = clock_seconds() - c->sent;
+		int bucket = latency * 1000;
+
+		st->latency[bucket < LOADGEN_BUCKETS ? bucket : LOADGEN_BUCKETS - 1]++;
+		st->latency_total += latency;
+		if (latency > st->latency_max) st->latency_max = latency;
+		st->moves++;
+
+		MoveBuf buf;
+		generate_moves(&(c->pos), c->pos.turn, &buf);
+		if (!server_match_move(&buf, line + 7, &m)) {
+			st->errors++;
+			return false;
+		}
+		position_apply(&(c->pos), m);
+		c->plies++;
+		return loadgen_move(c);
+	}
+
+	if (strncmp(line, "gameover ", 9) == 0) {
+		const char *result = line + 9;
+		st->games++;
+		st->results[strcmp(result, "1-0") == 0 ? 0 : strcmp(result, "0-1") == 0 ? 1 : 2]++;
+		if (--c->games_left > 0) return loadgen_send(c, "new black\n");
+		loadgen_send(c, "quit\n");
+		return false;
+	}
+
+	// "busy", "illegal" or an error
+	st->errors++;
+	return false;
+}
+
+/* latency below which "fraction" of the answers came */
+static double
+loadgen_percentile(const LoadStats *st, double fraction){
+
+	uint64_t total = 0, seen = 0;
+
+	for (int i = 0; i<LOADGEN_BUCKETS; ++i) total += st->latency[i];
+	for (int i = 0; i<LOADGEN_BUCKETS; ++i) {
+		seen += st->latency[i];
+		if (total && seen >= fraction * total) return (i + 1) / 1000.0;
+	}
+	return 0;
+}
+
+/*
+	checkers loadgen [-p port] [-c connections] [-g games per connection] [-s seed]
+*/
+int
+loadgen_main(int argc, char *argv[]){
+
+	int port = SERVER_PORT, connections = 100, games = 1;
+	uint64_t seed = 1;
+
+	for (int i = 1; i + 1<argc; ++i) {
+		if (strcmp(argv[i], "-p") == 0)      port = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0) connections = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-g") == 0) games = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-s") == 0) seed = strtoull(argv[++i], NULL, 10);
+	}
+	if (connections < 1) connections = 1;
+	if (games < 1) games = 1;
+
+	raise_fd_limit();
+	zobrist_init();
+
+	LoadConn *conns = calloc(connections, sizeof(LoadConn));
+	static LoadStats st;
+	int epoll = epoll_create1(0);
+	if (conns == NULL || epoll < 0) return 1;
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	double start = clock_seconds();
+	int open = 0;
+
+	for (int i = 0; i<connections; ++i) {
+		LoadConn *c = &(conns[i]);
+		int one = 1;
+
+		c->fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+			if (c->fd >= 0) close(c->fd);
+			c->fd = -1;
+			st.errors++;
+			continue;
+		}
+		setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+		set_nonblocking(c->fd);
+
+		c->games_left = games;
+		c->rng = (seed + (uint64_t)i * 0x9E3779B97F4A7C15ull) | 1;
+		setup_board(&(c->pos));
+
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+		epoll_ctl(epoll, EPOLL_CTL_ADD, c->fd, &ev);
+		open++;
+	}
+
+	if (open == 0) {
+		printf("Couldn't connect to port %d\n", port);
+		return 1;
+	}
+
+	struct epoll_event events[SERVER_EVENTS];
+
+	while (open > 0) {
+		int n = epoll_wait(epoll, events, SERVER_EVENTS, -1);
+		if (n < 0 && errno != EINTR) break;
+
+		for (int i = 0; i<n; ++i) {
+			LoadConn *c = events[i].data.ptr;
+			bool alive = true;
+
+			ssize_t got = recv(c->fd, c->in + c->in_len, SERVER_LINE - c->in_len, 0);
+			if (got <= 0) {
+				if (got < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+				alive = false;
+				st.errors += c->games_left > 0;
+			}
+			else
+				c->in_len += got;
+
+			char *end;
+			while (alive && (end = memchr(c->in, '\n', c->in_len))) {
+				*end = '\0';
+				alive = loadgen_line(c, &st, c->in);
+				int used = end - c->in + 1;
+				memmove(c->in, c->in + used, c->in_len - used);
+				c->in_len -= used;
+			}
+
+			if (!alive) {
+				epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, NULL);
+				close(c->fd);
+				c->fd = -1;
+				open--;
+			}
+		}
+	}
+
+	double elapsed = clock_seconds() - start;
+
+	printf("%d connection(s), %llu games (black %llu, white %llu, draws %llu), %llu engine moves in %.2f s\n",
+	       connections, (unsigned long long)st.games, (unsigned long long)st.results[0],
+	       (unsigned long long)st.results[1], (unsigned long long)st.results[2],
+	       (unsigned long long)st.moves, elapsed);
+	printf("%.1f games/s, %.0f engine moves/s, latency %.1f ms average, %.0f ms p50, %.0f ms p99, %.1f ms max\n",
+	       elapsed > 0 ? st.games / elapsed : 0.0, elapsed > 0 ? st.moves / elapsed : 0.0,
+	       st.moves ? 1000 * st.latency_total / st.moves : 0.0,
+	       1000 * loadgen_percentile(&st, 0.5), 1000 * loadgen_percentile(&st, 0.99),
+	       1000 * st.latency_max);
+	printf("%llu error(s)\n", (unsigned long long)st.errors);
+
+	close(epoll);
+	free(conns);
+	return st.errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,744 @@
+#include <pthread.h>
+
+#include "checkers.h"
+
+/*
+	the solver: proves (or refutes) that the side to move can force a win,
+	with depth-first proof-number search (df-pn)
+
+		checkers solve <FEN> [-d plies] [-n nodes] [-t seconds] [-m MB] [-j threads]
+		                     [-e tablebase dir] [-l tree lines]
+
+	every node keeps its numbers from the side to move's point of view:
+	phi is how many leaves at least still have to be proven for it to win,
+	delta how many for it to lose (so phi and delta are the proof and
+	disproof numbers where the attacker moves, and the other way around
+	where the defender does), a node's phi is the smallest delta of its
+	children and its delta the sum of their phis
+
+	only a win for the attacker counts, so anything else is a win for the
+	defender: running out of plies with -d (the key has the plies that are
+	left in it then), a tablebase draw and, without -d, a position that
+	repeats on the path, which means a proof never rests on any of them
+	a refutation can, and a draw by repetition is only one on the path it
+	was found on, yet it's stored like any other result: so the results
+	that rest on one are marked ("cycle"), and a refutation of the root
+	with the mark is only reported as one that wasn't proven
+	(with -d the plies that are left only go down, so there's no need to
+	look for repetitions, and every answer is a proven one)
+
+	the results live in a table of fixed size (-m), the entries with the
+	least work behind them are the first to go
+
+	with more than one thread the root is split: the moves of the first
+	position that has more than one are handed out round robin, with
+	thresholds that double every round so the easy ones get done first,
+	and all the threads share the table
+*/
+
+// a number that big is a result: the node is proven (or refuted) for one side
+#define SOLVE_INF	((1u << 28) - 1)
+#define SOLVE_MAX	(SOLVE_INF - 1)
+
+#define SOLVE_BUCKET	4
+#define SOLVE_MAX_PLY	256
+#define SOLVE_DEFAULT_MB	64
+
+// the thresholds of the split's first round, they double every round
+#define SOLVE_SPLIT_START	16
+
+/*
+	a child may go a quarter past the second best before the search
+	switches to that one (the 1 + epsilon trick), so it doesn't keep
+	going back and forth between two about as good children
+*/
+#define SOLVE_EPSILON	4
+
+// the nodes a thread counts before it adds them up and checks the limits
+#define SOLVE_CHECK_NODES	1024
+
+// mixed into the key for every ply that's left with -d
+#define SOLVE_PLY_KEY	0x9E3779B97F4A7C15ull
+
+#define LOAD(X)		__atomic_load_n(&(X), __ATOMIC_RELAXED)
+#define STORE(X, V)	__atomic_store_n(&(X), (V), __ATOMIC_RELAXED)
+
+typedef
+struct {
+	uint32_t phi;
+	uint32_t delta;
+	uint8_t work;		// about log2 of the nodes it took
+	bool cycle;		// it rests on a repetition (or on running out of plies without -d)
+} SolveEntry;
+
+/* packed like the transposition table's slots: the key xor'd with the data */
+typedef
+struct {
+	uint64_t check;
+	uint64_t data;
+} SolveSlot;
+
+typedef
+struct {
+	SolveSlot slots[SOLVE_BUCKET];
+} SolveBucket;
+
+static SolveBucket *solve_table = NULL;
+static uint64_t solve_mask = 0;
+
+typedef
+struct {
+	COLOR attacker;
+	int max_ply;		// 0 is no limit
+	uint64_t node_limit;
+	double time_limit;
+	double start;
+	atomic_bool stop;
+	atomic_uint_fast64_t nodes;
+} Solver;
+
+/* what one thread needs, the positions on its path are for the repetitions */
+typedef
+struct {
+	Solver *solver;
+	uint64_t nodes;
+	uint64_t counted;	// how many of them are in solver->nodes
+	uint64_t path[SOLVE_MAX_PLY + 1];
+	// the ply of the last man move or capture before every ply
+	int since[SOLVE_MAX_PLY + 1];
+} SolveThread;
+
+typedef
+struct {
+	Position pos;
+	uint64_t key;
+	int since;		// the ply of the last man move or capture before it
+	bool fixed;		// a repetition, "entry" is all there is to it
+	SolveEntry entry;
+} SolveChild;
+
+/* (re)allocates the table with as many buckets as fit into "mb" megabytes */
+static bool
+solve_table_init(size_t mb){
+
+	size_t buckets = 1;
+	while (buckets * 2 * sizeof(SolveBucket) <= mb * 1024 * 1024)
+		buckets *= 2;
+
+	free(solve_table);
+	solve_table = calloc(buckets, sizeof(SolveBucket));
+	solve_mask = solve_table ? buckets - 1 : 0;
+
+	return solve_table != NULL;
+}
+
+static void
+solve_table_free(void){
+	free(solve_table);
+	solve_table = NULL;
+	solve_mask = 0;
+}
+
+static uint64_t
+solve_key(const Solver *s, const Position *pos, int ply){
+	return s->max_ply ? pos->hash ^ (uint64_t)(s->max_ply - ply) * SOLVE_PLY_KEY : pos->hash;
+}
+
+static bool
+solve_probe(uint64_t key, SolveEntry *e){
+
+	SolveBucket *bucket = &(solve_table[key & solve_mask]);
+
+	for (int i = 0; i<SOLVE_BUCKET; ++i) {
+		uint64_t data = LOAD(bucket->slots[i].data);
+		if ((LOAD(bucket->slots[i].check) ^ data) == key && data) {
+			e->phi = data & SOLVE_INF;
+			e->delta = (data >> 28) & SOLVE_INF;
+			e->work = (data >> 56) & 127;
+			e->cycle = data >> 63;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* into the key's own slot, an empty one, or the one with the least work */
+static void
+solve_store(uint64_t key, const SolveEntry *e){
+
+	SolveBucket *bucket = &(solve_table[key & solve_mask]);
+	uint64_t data = (uint64_t)e->phi | (uint64_t)e->delta << 28 | (uint64_t)e->work << 56 |
+	                (uint64_t)e->cycle << 63;
+	int slot = 0, least = 256;
+
+	for (int i = 0; i<SOLVE_BUCKET; ++i) {
+		uint64_t old = LOAD(bucket->slots[i].data);
+		if (old == 0 || (LOAD(bucket->slots[i].check) ^ old) == key) {
+			slot = i;
+			break;
+		}
+		if ((int)((old >> 56) & 127) < least) {
+			least = (old >> 56) & 127;
+			slot = i;
+		}
+	}
+
+	STORE(bucket->slots[slot].data, data);
+	STORE(bucket->slots[slot].check, key ^ data);
+}
+
+/* how many of the table's slots are in use, per mille (of the first 1000 buckets) */
+static int
+solve_table_full(void){
+
+	uint64_t buckets = solve_mask + 1 < 1000 ? solve_mask + 1 : 1000;
+	int used = 0;
+
+	for (uint64_t b = 0; b<buckets; ++b)
+		for (int i = 0; i<SOLVE_BUCKET; ++i)
+			used += solve_table[b].slots[i].data != 0;
+
+	return used * 1000 / (buckets * SOLVE_BUCKET);
+}
+
+/* the numbers of a node that's decided: won for the attacker or not */
+static void
+solve_set(const Solver *s, const Position *pos, bool attacker_wins, SolveEntry *e){
+
+	bool mover_wins = (pos->turn == s->attacker) == attacker_wins;
+
+	e->phi = mover_wins ? 0 : SOLVE_INF;
+	e->delta = mover_wins ? SOLVE_INF : 0;
+	e->work = 0;
+	e->cycle = false;
+}
+
+static bool
+solve_decided(const SolveEntry *e){
+	return e->phi == 0 || e->delta == 0;
+}
+
+/*
+	decides a node without looking at its moves where it can:
+	in the tablebases, or out of plies
+*/
+static bool
+solve_leaf(const Solver *s, const Position *pos, int ply, SolveEntry *e){
+
+	uint8_t value;
+	int left = s->max_ply ? s->max_ply - ply : SOLVE_MAX_PLY - ply;
+
+	/*
+		the tablebase's distances are the fastest win, so with -d a win
+		that doesn't fit into the plies left is no win at all, unless the
+		distance was too long to store (TB_MAX_DISTANCE), that one's searched
+	*/
+	if (tb_probe(pos, &value)) {
+		bool won = pos->turn == s->attacker ? TB_IS_WIN(value) : TB_IS_LOSS(value);
+		if (won && s->max_ply && TB_DISTANCE(value) > left) {
+			if (TB_DISTANCE(value) < TB_MAX_DISTANCE) {
+				solve_set(s, pos, false, e);
+				return true;
+			}
+		}
+		else {
+			solve_set(s, pos, won, e);
+			return true;
+		}
+	}
+
+	// a side without moves has still lost on the last ply
+	if (left <= 0) {
+		bool stuck = !(movable_pieces(pos, pos->turn) | capturing_pieces(pos, pos->turn));
+		solve_set(s, pos, stuck && pos->turn != s->attacker, e);
+		e->cycle = !stuck && !s->max_ply;
+		return true;
+	}
+
+	return false;
+}
+
+/* counts a node, and every so often checks the node and time limits */
+static void
+solve_count(SolveThread *t){
+
+	Solver *s = t->solver;
+
+	t->nodes++;
+	if (t->nodes - t->counted < SOLVE_CHECK_NODES) return;
+
+	uint64_t nodes = atomic_fetch_add(&(s->nodes), t->nodes - t->counted) + (t->nodes - t->counted);
+	STAT_ADD(STAT_SOLVE_NODES, t->nodes - t->counted);
+	t->counted = t->nodes;
+
+	if ((s->node_limit && nodes >= s->node_limit) ||
+	    (s->time_limit > 0 && clock_seconds() - s->start >= s->time_limit))
+		atomic_store(&(s->stop), true);
+}
+
+static void
+solve_flush(SolveThread *t){
+	atomic_fetch_add(&(t->solver->nodes), t->nodes - t->counted);
+	STAT_ADD(STAT_SOLVE_NODES, t->nodes - t->counted);
+	t->counted = t->nodes;
+}
+
+/*
+	the children of the node at "ply" on the thread's path, a child that's
+	already on the path (with the same side to move) is a repetition
+*/
+static int
+solve_children(SolveThread *t, const Position *pos, int ply, MoveBuf *buf, SolveChild *children){
+
+	const Solver *s = t->solver;
+
+	generate_moves(pos, pos->turn, buf);
+
+	for (int i = 0; i<buf->len; ++i) {
+		Move m = buf->moves[i];
+		SolveChild *c = &(children[i]);
+		c->pos = *pos;
+		position_apply(&(c->pos), m);
+		c->key = solve_key(s, &(c->pos), ply + 1);
+		c->since = MOVE_TAKEN(m) || !(pos->kings & SQ_BIT(MOVE_FROM(m))) ? ply + 1 : t->since[ply];
+		c->fixed = false;
+
+		// with -d there are no cycles (the plies that are left go down), nothing repeats
+		for (int p = ply - 1; !s->max_ply && p>=c->since; p -= 2)
+			if (t->path[p] == c->pos.hash) {
+				c->fixed = true;
+				solve_set(s, &(c->pos), false, &(c->entry));
+				c->entry.cycle = true;
+				break;
+			}
+	}
+
+	return buf->len;
+}
+
+/*
+	the node's phi and delta from its children's, with the child to go
+	into next (the smallest delta) and the second smallest delta
+*/
+static void
+solve_sum(SolveChild *children, int len, SolveEntry *out, int *best, uint32_t *second){
+
+	uint64_t delta = 0;
+	bool infinite = false, any_cycle = false, clean_win = false;
+
+	out->phi = SOLVE_INF;
+	*best = 0;
+	*second = SOLVE_INF;
+
+	for (int i = 0; i<len; ++i) {
+		SolveEntry *e = &(children[i].entry);
+
+		if (!children[i].fixed && !solve_probe(children[i].key, e)) {
+			e->phi = 1;
+			e->delta = 1;
+			e->work = 0;
+			e->cycle = false;
+		}
+
+		if (e->delta < out->phi) {
+			*second = out->phi;
+			out->phi = e->delta;
+			*best = i;
+		}
+		else if (e->delta < *second)
+			*second = e->delta;
+
+		// a child its side to move can't win makes the node a win, anything else only adds up
+		if (e->phi == SOLVE_INF) infinite = true;
+		else delta += e->phi;
+
+		any_cycle |= e->cycle;
+		if (e->delta == 0 && !e->cycle) clean_win = true;
+	}
+
+	// a win needs one move that's won without a repetition, a loss has all of them
+	out->cycle = out->phi == 0 ? !clean_win : any_cycle;
+
+	out->delta = infinite ? SOLVE_INF : (delta > SOLVE_MAX ? SOLVE_MAX : delta);
+}
+
+static uint8_t
+solve_work(uint64_t nodes){
+	uint8_t work = 0;
+	for (; nodes && work < 127; nodes >>= 1) work++;
+	return work;
+}
+
+/*
+	the search itself: works on the node until its phi reaches "th_phi" or
+	its delta "th_delta" (or the limits are hit), and stores what it found
+	the node is at "ply" on the thread's path
+*/
+static void
+solve_mid(SolveThread *t, const Position *pos, int ply, uint32_t th_phi, uint32_t th_delta,
+          SolveEntry *out){
+
+	Solver *s = t->solver;
+	SolveChild children[MAX_MOVES];
+	MoveBuf buf;
+	uint64_t key = solve_key(s, pos, ply);
+	uint64_t start = t->nodes;
+	uint32_t second;
+	int best;
+
+	solve_count(t);
+
+	if (solve_leaf(s, pos, ply, out)) {
+		solve_store(key, out);
+		return;
+	}
+
+	int len = solve_children(t, pos, ply, &buf, children);
+	if (len == 0) {
+		// no moves, no pieces: lost
+		solve_set(s, pos, pos->turn != s->attacker, out);
+		solve_store(key, out);
+		return;
+	}
+
+	t->path[ply] = pos->hash;
+
+	for (;;) {
+		solve_sum(children, len, out, &best, &second);
+		if (out->phi >= th_phi || out->delta >= th_delta || atomic_load(&(s->stop)))
+			break;
+
+		// the child's delta can go up to (a bit past) the second best's, its phi as far as the sum allows
+		SolveChild *c = &(children[best]);
+		uint64_t child_phi = (uint64_t)th_delta - out->delta + c->entry.phi;
+		uint64_t child_delta = second + second / SOLVE_EPSILON + 1;
+
+		t->since[ply + 1] = c->since;
+		solve_mid(t, &(c->pos), ply + 1, child_phi < SOLVE_INF ? child_phi : SOLVE_INF,
+		          child_delta < th_phi ? child_delta : th_phi, &(c->entry));
+	}
+
+	out->work = solve_work(t->nodes - start);
+	solve_store(key, out);
+}
+
+/*
+	a child's entry for the solution tree: the table may have lost it
+	since it was proven, then it's proven again (with most of the tree
+	below it still in the table that doesn't take long)
+*/
+static void
+solve_again(SolveThread *t, const SolveChild *c, int ply, SolveEntry *e){
+
+	if (c->fixed) {
+		*e = c->entry;
+		return;
+	}
+	if (solve_probe(c->key, e) && solve_decided(e)) return;
+
+	t->since[ply + 1] = c->since;
+	solve_mid(t, &(c->pos), ply + 1, SOLVE_INF, SOLVE_INF, e);
+}
+
+/*
+	prints the proof, a move per line indented by its ply: the attacker's
+	winning move (the one that took the least work) and every defence
+	"lines" is how many more it may print
+*/
+static void
+solve_tree(SolveThread *t, const Position *pos, int ply, int *lines){
+
+	const Solver *s = t->solver;
+	SolveChild children[MAX_MOVES];
+	MoveBuf buf;
+	SolveEntry e;
+	uint8_t value;
+	char notation[4 * (MAX_CAPTURES + 1)];
+
+	if (solve_leaf(s, pos, ply, &e)) {
+		if (tb_probe(pos, &value) && (*lines)-- > 0)
+			printf("%*s(tablebase)\n", 2 * ply, "");
+		return;
+	}
+
+	int len = solve_children(t, pos, ply, &buf, children);
+	int best = -1;
+	t->path[ply] = pos->hash;
+
+	if (pos->turn == s->attacker) {
+		bool tried[MAX_MOVES] = { false };
+		uint32_t delta[MAX_MOVES];
+		int least = 256;
+
+		for (int i = 0; i<len; ++i) {
+			delta[i] = SOLVE_INF;
+			if (children[i].fixed) continue;
+			delta[i] = solve_probe(children[i].key, &e) ? e.delta : 1;
+			if (delta[i] == 0 && e.work < least) {
+				best = i;
+				least = e.work;
+			}
+		}
+
+		// the table lost them: proven again, the most promising first
+		while (best < 0) {
+			int next = -1;
+			for (int i = 0; i<len; ++i)
+				if (!tried[i] && delta[i] < SOLVE_INF && (next < 0 || delta[i] < delta[next]))
+					next = i;
+			if (next < 0) return;
+
+			tried[next] = true;
+			solve_again(t, &(children[next]), ply, &e);
+			if (e.delta == 0) best = next;
+		}
+	}
+
+	for (int i = 0; i<len; ++i) {
+		if (best >= 0) i = best;
+
+		if (*lines <= 0) {
+			printf("%*s...\n", 2 * ply, "");
+			return;
+		}
+		(*lines)--;
+
+		move_format_path(buf.moves[i], notation);
+		printf("%*s%s%s\n", 2 * ply, "", notation, children[i].fixed ? " (repetition)" : "");
+		if (!children[i].fixed) {
+			t->since[ply + 1] = children[i].since;
+			solve_tree(t, &(children[i].pos), ply + 1, lines);
+		}
+
+		if (best >= 0) break;
+	}
+}
+
+/*
+	the split: the first position on the way from the root with more than one
+	move, its moves go round robin to the threads (see the top of the file)
+*/
+typedef
+struct {
+	Solver *solver;
+	Position pos;
+	int ply;
+	int len;
+	SolveChild children[MAX_MOVES];
+	atomic_uint next;
+	atomic_bool done;
+} SolveSplit;
+
+typedef
+struct {
+	SolveSplit *split;
+	SolveThread thread;
+} SolveWork;
+
+static void *
+solve_split_thread(void *arg){
+
+	SolveWork *work = arg;
+	SolveSplit *split = work->split;
+	SolveThread *t = &(work->thread);
+	Solver *s = split->solver;
+	SolveChild children[MAX_MOVES];
+	SolveEntry sum;
+	uint32_t second;
+	int best;
+
+	stats_thread_start();
+	memcpy(children, split->children, split->len * sizeof(SolveChild));
+
+	while (!atomic_load(&(s->stop)) && !atomic_load(&(split->done))) {
+		unsigned k = atomic_fetch_add(&(split->next), 1);
+		int i = k % split->len, round = k / split->len;
+
+		solve_sum(children, split->len, &sum, &best, &second);
+		if (solve_decided(&sum)) {
+			atomic_store(&(split->done), true);
+			break;
+		}
+		if (solve_decided(&(children[i].entry))) continue;
+
+		uint32_t th = round < 24 ? (uint32_t)SOLVE_SPLIT_START << round : SOLVE_INF;
+		t->since[split->ply + 1] = children[i].since;
+		solve_mid(t, &(children[i].pos), split->ply + 1, th < SOLVE_INF ? th : SOLVE_INF,
+		          th < SOLVE_INF ? th : SOLVE_INF, &(children[i].entry));
+	}
+
+	solve_flush(t);
+	return NULL;
+}
+
+/*
+	solves "root" with "threads" threads, "workers" has one SolveThread for
+	each, the first is the calling thread's
+*/
+static void
+solve_position(Solver *s, const Position *root, int threads, SolveWork *workers, SolveEntry *out){
+
+	SolveThread *main_thread = &(workers[0].thread);
+	SolveSplit *split = NULL;
+	MoveBuf buf;
+
+	// the only place it's cleared, a stop that comes during the solve holds till the end
+	atomic_store(&(s->stop), false);
+
+	for (int i = 0; i<threads; ++i) {
+		memset(&(workers[i].thread), 0, sizeof(SolveThread));
+		workers[i].thread.solver = s;
+	}
+
+	if (threads > 1 && (split = malloc(sizeof(SolveSplit))) != NULL) {
+		SolveEntry leaf;
+		Position pos = *root;
+		Position forced[SOLVE_MAX_PLY / 2 + 1];
+		int ply = 0;
+
+		// down the forced moves, the repetitions of the path don't come up there
+		while (ply < SOLVE_MAX_PLY / 2 && !solve_leaf(s, &pos, ply, &leaf)) {
+			forced[ply] = pos;
+			main_thread->path[ply] = pos.hash;
+			split->len = solve_children(main_thread, &pos, ply, &buf, split->children);
+			if (split->len != 1) break;
+			main_thread->since[ply + 1] = split->children[0].since;
+			pos = split->children[0].pos;
+			ply++;
+		}
+
+		if (split->len < 2 || ply >= SOLVE_MAX_PLY / 2) {
+			free(split);
+			split = NULL;
+		}
+		else {
+			pthread_t handles[MAX_THREADS];
+
+			split->solver = s;
+			split->pos = pos;
+			split->ply = ply;
+			atomic_init(&(split->next), 0);
+			atomic_init(&(split->done), false);
+
+			for (int i = 0; i<threads; ++i) {
+				workers[i].split = split;
+				if (i > 0) {
+					memcpy(workers[i].thread.path, main_thread->path, sizeof main_thread->path);
+					memcpy(workers[i].thread.since, main_thread->since, sizeof main_thread->since);
+				}
+			}
+			for (int i = 1; i<threads; ++i)
+				pthread_create(&(handles[i]), NULL, solve_split_thread, &(workers[i]));
+			solve_split_thread(&(workers[0]));
+			for (int i = 1; i<threads; ++i)
+				pthread_join(handles[i], NULL);
+
+			/*
+				the split is decided or the limits stopped it, and the forced moves
+				up to it only pass that on: it and they go into the table, so the
+				root gets what the split found from there even with the stop set
+				(with the whole split's work, so the table keeps them)
+			*/
+			SolveEntry sum;
+			uint32_t second;
+			int best;
+
+			solve_sum(split->children, split->len, &sum, &best, &second);
+			sum.work = solve_work(atomic_load(&(s->nodes)));
+			solve_store(solve_key(s, &pos, ply), &sum);
+			for (int p = ply - 1; p>0; --p) {
+				int len = solve_children(main_thread, &(forced[p]), p, &buf, split->children);
+				solve_sum(split->children, len, &sum, &best, &second);
+				sum.work = solve_work(atomic_load(&(s->nodes)));
+				solve_store(solve_key(s, &(forced[p]), p), &sum);
+			}
+			free(split);
+		}
+	}
+
+	solve_mid(main_thread, root, 0, SOLVE_INF, SOLVE_INF, out);
+	solve_flush(main_thread);
+}
+
+/*
+	checkers solve <FEN> [-d plies] [-n nodes] [-t seconds] [-m MB] [-j threads]
+	                     [-e tablebase dir] [-l tree lines]
+*/
+int
+solve_main(int argc, char *argv[]){
+
+	Solver s;
+	Position pos;
+	size_t mb = SOLVE_DEFAULT_MB;
+	int threads = 1, lines = 200;
+
+	if (argc < 2 || !position_from_fen(&pos, argv[1])) {
+		if (argc >= 2) printf("Invalid FEN: %s\n", argv[1]);
+		printf("usage: checkers solve <FEN> [-d plies] [-n nodes] [-t seconds] [-m MB] [-j threads]\n"
+		       "                            [-e tablebase dir] [-l tree lines]\n");
+		return 1;
+	}
+
+	memset(&s, 0, sizeof s);
+	s.attacker = pos.turn;
+	s.time_limit = 60;
+
+	for (int i = 2; i + 1<argc; i += 2) {
+		if (strcmp(argv[i], "-d") == 0)      s.max_ply = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-n") == 0) s.node_limit = strtoull(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-t") == 0) s.time_limit = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-m") == 0) mb = strtoul(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-j") == 0) threads = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-e") == 0) tb_init(argv[i + 1], TB_MAX_PIECES);
+		else if (strcmp(argv[i], "-l") == 0) lines = atoi(argv[i + 1]);
+	}
+	if (s.max_ply < 0 || s.max_ply > SOLVE_MAX_PLY) s.max_ply = SOLVE_MAX_PLY;
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+	SolveWork *workers = malloc(threads * sizeof(SolveWork));
+	if (workers == NULL || !solve_table_init(mb)) {
+		printf("Couldn't allocate a %zu MB table\n", mb);
+		free(workers);
+		return 1;
+	}
+
+	const char *side = pos.turn == BLACK ? "black" : "white";
+	SolveEntry root;
+	char within[32] = "";
+
+	if (s.max_ply)
+		sprintf(within, " within %d plies", s.max_ply);
+
+	s.start = clock_seconds();
+	solve_position(&s, &pos, threads, workers, &root);
+	double elapsed = clock_seconds() - s.start;
+	uint64_t nodes = atomic_load(&(s.nodes));
+
+	// the root is the attacker's, so phi and delta are its proof and disproof numbers
+	if (root.phi == 0)        printf("win for %s%s\n", side, within);
+	else if (root.delta == 0 && !root.cycle)
+		printf("no win for %s%s\n", side, within);
+	else if (root.delta == 0)
+		printf("no win found for %s%s, but the defence repeats positions (try -d)\n", side, within);
+	else                      printf("not proven within the budget (proof number %u, disproof number %u)\n",
+	                                 root.phi, root.delta);
+	printf("%llu nodes in %.3f s (%.0f nodes/s), %d thread(s), table %d per mille full\n",
+	       (unsigned long long)nodes, elapsed, elapsed > 0 ? nodes / elapsed : 0.0, threads,
+	       solve_table_full());
+
+	if (root.phi == 0) {
+		// the proof again, with no limits, it's known to be there
+		s.node_limit = 0;
+		s.time_limit = 0;
+		atomic_store(&(s.stop), false);
+		printf("solution:\n");
+		solve_tree(&(workers[0].thread), &pos, 0, &lines);
+	}
+
+	free(workers);
+	solve_table_free();
+	tb_close();
+	return 0;
+}
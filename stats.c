@@ -0,0 +1,180 @@
+#include <pthread.h>
+
+#include "checkers.h"
+
+/*
+	engine statistics
+
+	every thread counts into its own StatsBlock (STAT_ADD in checkers.h),
+	the blocks of the running threads are kept on a list, and when a thread
+	ends its counts are added to the totals of the threads that are gone
+	a thread is only on the list after stats_thread_start, the entry points
+	of the threads (the main thread, search, selfplay, tablebase workers)
+	call it, what a thread counted before that still gets in when it ends
+
+	"stats" in the game and in the protocol prints them, and with the
+	CHECKERS_STATS environment variable set to a file name ("-" for stderr)
+	they're written there as JSON when the program exits
+*/
+
+static const char *STAT_NAMES[STAT_COUNT] = {
+	"generate_moves", "legal_rebuilds", "available_moves", "do_move", "illegal_moves",
+	"history_grow", "searches", "nodes", "cutoffs", "first_move_cutoffs",
+	"tt_probes", "tt_hits", "tt_cutoffs", "tb_hits", "evals", "nnue_evals", "nnue_updates",
+	"solve_nodes",
+	"playouts",
+	"search", "perft", "render", "input",
+};
+
+#ifndef NO_STATS
+_Thread_local StatsBlock stats_local;
+#endif
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static StatsBlock *stats_running = NULL;
+static uint64_t stats_ended[STAT_COUNT];
+static int stats_threads = 0;
+static double stats_start = 0;
+static const char *stats_path = NULL;
+
+#ifndef NO_STATS
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+/* runs when a thread that called stats_thread_start ends */
+static void
+stats_thread_end(void *arg){
+
+	StatsBlock *block = arg;
+
+	pthread_mutex_lock(&stats_lock);
+	for (StatsBlock **b = &stats_running; *b; b = &((*b)->next))
+		if (*b == block) {
+			*b = block->next;
+			break;
+		}
+	for (int i = 0; i<STAT_COUNT; ++i)
+		stats_ended[i] += block->count[i];
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static void
+stats_key_init(void){
+	pthread_key_create(&stats_key, stats_thread_end);
+}
+#endif
+
+void
+stats_thread_start(void){
+#ifndef NO_STATS
+	if (stats_local.registered) return;
+
+	pthread_once(&stats_once, stats_key_init);
+	pthread_setspecific(stats_key, &stats_local);
+
+	pthread_mutex_lock(&stats_lock);
+	stats_local.registered = true;
+	stats_local.next = stats_running;
+	stats_running = &stats_local;
+	stats_threads++;
+	pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+/*
+	the counts of all threads so far, the running ones are read while
+	they count, so theirs can be a few adds behind
+*/
+void
+stats_sum(uint64_t count[STAT_COUNT], int *threads){
+
+	pthread_mutex_lock(&stats_lock);
+	memcpy(count, stats_ended, sizeof stats_ended);
+	for (StatsBlock *b = stats_running; b; b = b->next)
+		for (int i = 0; i<STAT_COUNT; ++i)
+			count[i] += __atomic_load_n(&(b->count[i]), __ATOMIC_RELAXED);
+	if (threads) *threads = stats_threads;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+static double
+stats_ratio(uint64_t a, uint64_t b){
+	return b ? (double)a / b : 0.0;
+}
+
+void
+stats_print(FILE *f){
+
+	uint64_t count[STAT_COUNT];
+	int threads;
+
+#ifdef NO_STATS
+	fprintf(f, "statistics are compiled out (NO_STATS)\n");
+	return;
+#endif
+
+	stats_sum(count, &threads);
+
+	fprintf(f, "%d thread(s), %.2f s\n", threads, clock_seconds() - stats_start);
+	for (int i = 0; i<STAT_TIME_SEARCH; ++i)
+		fprintf(f, "%-20s %llu\n", STAT_NAMES[i], (unsigned long long)count[i]);
+	for (int i = STAT_TIME_SEARCH; i<STAT_COUNT; ++i)
+		fprintf(f, "time %-15s %.3f s\n", STAT_NAMES[i], count[i] * 1e-9);
+
+	fprintf(f, "nodes/s %.0f, tt hits %.1f%%, first move cutoffs %.1f%%\n",
+	        stats_ratio(count[STAT_NODES], count[STAT_TIME_SEARCH]) * 1e9,
+	        100 * stats_ratio(count[STAT_TT_HITS], count[STAT_TT_PROBES]),
+	        100 * stats_ratio(count[STAT_FIRST_CUTOFFS], count[STAT_CUTOFFS]));
+}
+
+/* the same as one JSON object on one line */
+void
+stats_json(FILE *f){
+
+	uint64_t count[STAT_COUNT];
+	int threads;
+	bool enabled = true;
+
+#ifdef NO_STATS
+	enabled = false;
+#endif
+
+	stats_sum(count, &threads);
+
+	fprintf(f, "{\"enabled\":%s,\"threads\":%d,\"uptime\":%.6f,\"counters\":{",
+	        enabled ? "true" : "false", threads, clock_seconds() - stats_start);
+	for (int i = 0; i<STAT_TIME_SEARCH; ++i)
+		fprintf(f, "%s\"%s\":%llu", i ? "," : "", STAT_NAMES[i], (unsigned long long)count[i]);
+	fprintf(f, "},\"time\":{");
+	for (int i = STAT_TIME_SEARCH; i<STAT_COUNT; ++i)
+		fprintf(f, "%s\"%s\":%.6f", i > STAT_TIME_SEARCH ? "," : "", STAT_NAMES[i], count[i] * 1e-9);
+	fprintf(f, "},\"nps\":%.0f,\"tt_hit_rate\":%.4f,\"first_move_cutoff_rate\":%.4f}\n",
+	        stats_ratio(count[STAT_NODES], count[STAT_TIME_SEARCH]) * 1e9,
+	        stats_ratio(count[STAT_TT_HITS], count[STAT_TT_PROBES]),
+	        stats_ratio(count[STAT_FIRST_CUTOFFS], count[STAT_CUTOFFS]));
+}
+
+static void
+stats_exit(void){
+
+	FILE *f = strcmp(stats_path, "-") == 0 ? stderr : fopen(stats_path, "w");
+
+	if (f == NULL) {
+		fprintf(stderr, "Couldn't write the statistics to %s\n", stats_path);
+		return;
+	}
+	stats_json(f);
+	if (f != stderr) fclose(f);
+}
+
+/* called first thing in main */
+void
+stats_init(void){
+
+	stats_start = clock_seconds();
+	stats_thread_start();
+
+	stats_path = getenv("CHECKERS_STATS");
+	if (stats_path && stats_path[0] != '\0')
+		atexit(stats_exit);
+}
@@ -0,0 +1,691 @@
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkers.h"
+
+/*
+	endgame tablebases
+
+	the positions are split into slices by material (black men, black kings,
+	white men, white kings), every slice is one file:
+
+		TBHeader
+		one byte for every index with black to move
+		one byte for every index with white to move
+
+	the byte is TB_DRAW, a win or a loss with the number of plies it takes
+	(see TB_WIN / TB_LOSS) or TB_INVALID for indices that don't describe a
+	real position
+
+	a slice is solved by retrograde analysis: every position's moves are
+	played once, the ones that leave the slice (captures, promotions) are
+	looked up in the finished smaller slices and the others are counted,
+	then the positions are settled by increasing distance from the end and
+	every one that gets settled is unmoved to tell its predecessors, which
+	count down their open moves (see tb_propagate_thread)
+	a position that's never settled is a draw, and one further from the
+	end than TB_MAX_DISTANCE fails the generation instead of being cut short
+
+	a slice's index is built with the combinatorial number system:
+	the black men pick their squares out of the 28 a black man can stand on,
+	the white men likewise (the two may collide, those indices are TB_INVALID),
+	then the black kings out of the squares the men left free and
+	the white kings out of what's left after that
+*/
+
+#define TB_MAGIC   "CKTB"
+#define TB_VERSION 1
+
+typedef
+struct {
+	char magic[4];
+	uint32_t version;
+	uint8_t counts[4];
+	uint32_t unused;
+	uint64_t size;
+} TBHeader;
+
+/* squares the men may stand on (they'd be kings on their last row) */
+#define BB_BLACK_MEN 0x0FFFFFFFu
+#define BB_WHITE_MEN 0xFFFFFFF0u
+
+/* the slice cache: an entry is NULL (not looked at yet), TB_MISSING or a mapped file */
+#define TB_SLICES  ((TB_MAX_PIECES + 1) * (TB_MAX_PIECES + 1) * (TB_MAX_PIECES + 1) * (TB_MAX_PIECES + 1))
+#define TB_MISSING ((TBHeader *)1)
+
+static TBHeader *tb_slices[TB_SLICES];
+static char tb_dir[256] = "tb";
+static int tb_pieces = 0;
+
+static uint64_t BINOMIAL[33][33];
+
+static void
+binomial_init(void){
+	if (BINOMIAL[0][0]) return;
+	for (int n = 0; n<=32; ++n) {
+		BINOMIAL[n][0] = 1;
+		for (int k = 1; k<=n; ++k)
+			BINOMIAL[n][k] = BINOMIAL[n-1][k-1] + (k < n ? BINOMIAL[n-1][k] : 0);
+	}
+}
+
+static int
+slice_id(const int counts[4]){
+	return ((counts[0] * (TB_MAX_PIECES + 1) + counts[1]) * (TB_MAX_PIECES + 1) + counts[2])
+	       * (TB_MAX_PIECES + 1) + counts[3];
+}
+
+static uint64_t
+slice_size(const int counts[4]){
+	int men = counts[0] + counts[2];
+	return BINOMIAL[28][counts[0]] * BINOMIAL[28][counts[2]]
+	     * BINOMIAL[32 - men][counts[1]] * BINOMIAL[32 - men - counts[1]][counts[3]];
+}
+
+static void
+slice_counts(const Position *pos, int counts[4]){
+	counts[0] = bb_popcount(pos->pieces[BLACK] & ~pos->kings);
+	counts[1] = bb_popcount(pos->pieces[BLACK] & pos->kings);
+	counts[2] = bb_popcount(pos->pieces[WHITE] & ~pos->kings);
+	counts[3] = bb_popcount(pos->pieces[WHITE] & pos->kings);
+}
+
+/* the rank of "set" among the subsets of "list" of the same size */
+static uint64_t
+rank_subset(Bitboard set, Bitboard list){
+	uint64_t rank = 0;
+	int i = 1;
+	while (set) {
+		Bitboard bit = set & -set;
+		set &= set - 1;
+		rank += BINOMIAL[bb_popcount(list & (bit - 1))][i++];
+	}
+	return rank;
+}
+
+/* the other way around: the "k" squares of "list" with the given rank */
+static Bitboard
+unrank_subset(uint64_t rank, int k, Bitboard list){
+	Bitboard set = 0;
+	int p = bb_popcount(list);
+	for (int i = k; i>=1; --i) {
+		p--;
+		while (BINOMIAL[p][i] > rank) p--;
+		rank -= BINOMIAL[p][i];
+
+		// the p-th (0 indexed) square of the list
+		Bitboard l = list;
+		for (int j = 0; j<p; ++j) l &= l - 1;
+		set |= l & -l;
+	}
+	return set;
+}
+
+static uint64_t
+tb_index(const Position *pos, const int counts[4]){
+
+	Bitboard bm = pos->pieces[BLACK] & ~pos->kings;
+	Bitboard wm = pos->pieces[WHITE] & ~pos->kings;
+	Bitboard bk = pos->pieces[BLACK] & pos->kings;
+	Bitboard wk = pos->pieces[WHITE] & pos->kings;
+	int men = counts[0] + counts[2];
+
+	uint64_t index = rank_subset(bm, BB_BLACK_MEN);
+	index = index * BINOMIAL[28][counts[2]] + rank_subset(wm, BB_WHITE_MEN);
+	index = index * BINOMIAL[32 - men][counts[1]] + rank_subset(bk, ~(bm | wm));
+	index = index * BINOMIAL[32 - men - counts[1]][counts[3]] + rank_subset(wk, ~(bm | wm | bk));
+
+	return index;
+}
+
+// returns false if the index doesn't stand for a real position
+static bool
+tb_unindex(uint64_t index, const int counts[4], COLOR turn, Position *pos){
+
+	int men = counts[0] + counts[2];
+	uint64_t n_wk = BINOMIAL[32 - men - counts[1]][counts[3]];
+	uint64_t n_bk = BINOMIAL[32 - men][counts[1]];
+	uint64_t n_wm = BINOMIAL[28][counts[2]];
+
+	uint64_t i_wk = index % n_wk; index /= n_wk;
+	uint64_t i_bk = index % n_bk; index /= n_bk;
+	uint64_t i_wm = index % n_wm; index /= n_wm;
+
+	Bitboard bm = unrank_subset(index, counts[0], BB_BLACK_MEN);
+	Bitboard wm = unrank_subset(i_wm, counts[2], BB_WHITE_MEN);
+	if (bm & wm) return false;
+	Bitboard bk = unrank_subset(i_bk, counts[1], ~(bm | wm));
+	Bitboard wk = unrank_subset(i_wk, counts[3], ~(bm | wm | bk));
+
+	pos->pieces[BLACK] = bm | bk;
+	pos->pieces[WHITE] = wm | wk;
+	pos->kings = bk | wk;
+	pos->turn = turn;
+	pos->hash = 0;
+
+	return true;
+}
+
+static void
+slice_path(const int counts[4], char *out, size_t len){
+	snprintf(out, len, "%s/%d%d%d%d.cktb", tb_dir, counts[0], counts[1], counts[2], counts[3]);
+}
+
+/* maps the slice's file the first time it's asked for */
+static const TBHeader *
+tb_slice(const int counts[4]){
+
+	int id = slice_id(counts);
+	TBHeader *slice = __atomic_load_n(&(tb_slices[id]), __ATOMIC_ACQUIRE);
+
+	if (slice) return slice == TB_MISSING ? NULL : slice;
+
+	char path[300];
+	struct stat st;
+	TBHeader *mapped = TB_MISSING;
+
+	slice_path(counts, path, sizeof path);
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TBHeader)) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			TBHeader *h = map;
+			if (memcmp(h->magic, TB_MAGIC, 4) == 0 && h->version == TB_VERSION &&
+			    (size_t)st.st_size >= sizeof(TBHeader) + 2 * h->size)
+				mapped = h;
+			else
+				munmap(map, st.st_size);
+		}
+	}
+	if (fd >= 0) close(fd);
+
+	// another thread may have mapped it in the meantime, then ours goes away
+	TBHeader *expected = NULL;
+	if (!__atomic_compare_exchange_n(&(tb_slices[id]), &expected, mapped, false,
+	                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		if (mapped != TB_MISSING)
+			munmap(mapped, sizeof(TBHeader) + 2 * mapped->size);
+		mapped = expected;
+	}
+
+	return mapped == TB_MISSING ? NULL : mapped;
+}
+
+/*
+	sets the directory the tablebases are in (nothing gets read here,
+	the files are mapped when they're first needed)
+	"pieces" is the most pieces a position can have to be looked up
+*/
+void
+tb_init(const char *dir, int pieces){
+	binomial_init();
+	tb_close();
+	snprintf(tb_dir, sizeof tb_dir, "%s", dir);
+	tb_pieces = pieces > TB_MAX_PIECES ? TB_MAX_PIECES : pieces;
+}
+
+void
+tb_close(void){
+	for (int i = 0; i<TB_SLICES; ++i) {
+		if (tb_slices[i] && tb_slices[i] != TB_MISSING)
+			munmap(tb_slices[i], sizeof(TBHeader) + 2 * tb_slices[i]->size);
+		tb_slices[i] = NULL;
+	}
+	tb_pieces = 0;
+}
+
+int
+tb_max_pieces(void){
+	return tb_pieces;
+}
+
+/*
+	looks the position up, writes the raw value into "value"
+	returns false if it's not in the tablebases
+*/
+bool
+tb_probe(const Position *pos, uint8_t *value){
+
+	int counts[4];
+
+	if (bb_popcount(pos->pieces[BLACK] | pos->pieces[WHITE]) > tb_pieces) return false;
+
+	// a side without pieces can't move
+	if (!pos->pieces[pos->turn]) {
+		*value = TB_LOSS(0);
+		return true;
+	}
+	if (!pos->pieces[!pos->turn]) return false;
+
+	slice_counts(pos, counts);
+	const TBHeader *slice = tb_slice(counts);
+	if (slice == NULL) return false;
+
+	const uint8_t *data = (const uint8_t *)(slice + 1);
+	*value = data[pos->turn * slice->size + tb_index(pos, counts)];
+
+	return *value != TB_INVALID;
+}
+
+/* a tablebase value as a search score, "ply" plies from the root */
+int
+tb_score(uint8_t value, int ply){
+	if (TB_IS_WIN(value))  return SCORE_TB - ply - TB_DISTANCE(value);
+	if (TB_IS_LOSS(value)) return -SCORE_TB + ply + TB_DISTANCE(value);
+	return 0;
+}
+
+/* GENERATION */
+
+// "win" and "loss" of a position that has nothing yet
+#define TB_NONE 255
+
+typedef
+struct {
+	int counts[4];
+	uint64_t size;
+	uint8_t *value;
+	// the moves of every position that stay in the slice and aren't known to be won yet
+	uint8_t *open;
+	// the nearest win found so far, or TB_NONE
+	uint8_t *win;
+	// how slowly the position is lost if it's lost, TB_NONE if it can't be
+	uint8_t *loss;
+} TBGen;
+
+typedef
+struct {
+	TBGen *gen;
+	uint64_t begin;
+	uint64_t end;
+	int distance;
+	uint64_t settled;
+	uint64_t pending;	// positions that know their value, but for a later distance
+	bool failed;
+} TBWork;
+
+/*
+	looks at every move of every position once: the moves that stay in the
+	slice are counted in "open", the ones that leave it (captures and
+	promotions) go to a finished slice and are looked up there
+*/
+static void *
+tb_init_thread(void *arg){
+
+	TBWork *work = arg;
+	TBGen *gen = work->gen;
+
+	stats_thread_start();
+
+	for (uint64_t i = work->begin; i<work->end; ++i) {
+		COLOR turn = i < gen->size ? BLACK : WHITE;
+		Position pos;
+		MoveBuf buf;
+		int open = 0, win = TB_NONE, loss = 0;
+
+		if (!tb_unindex(i - turn * gen->size, gen->counts, turn, &pos)) {
+			gen->value[i] = TB_INVALID;
+			continue;
+		}
+		gen->value[i] = TB_DRAW;
+
+		generate_moves(&pos, pos.turn, &buf);
+
+		for (int m = 0; m<buf.len; ++m) {
+			Position child = pos;
+			int counts[4];
+			uint8_t value;
+
+			position_apply(&child, buf.moves[m]);
+			slice_counts(&child, counts);
+
+			if (child.pieces[child.turn] == 0)
+				value = TB_LOSS(0);
+			else if (memcmp(counts, gen->counts, sizeof counts) == 0) {
+				open++;
+				continue;
+			}
+			// the smaller slices are all done and on disk by now
+			else if (!tb_probe(&child, &value))
+				value = TB_DRAW;
+
+			if (TB_IS_LOSS(value)) {
+				if (TB_DISTANCE(value) + 1 < win) win = TB_DISTANCE(value) + 1;
+			}
+			else if (TB_IS_WIN(value)) {
+				if (loss != TB_NONE && TB_DISTANCE(value) + 1 > loss) loss = TB_DISTANCE(value) + 1;
+			}
+			else
+				loss = TB_NONE;
+		}
+
+		gen->open[i] = open;
+		gen->win[i] = win;
+		gen->loss[i] = loss;
+	}
+
+	return NULL;
+}
+
+/*
+	settles the positions won or lost in exactly "distance" plies:
+	won when a move to a lost position is that close, lost when every
+	move is known to lead to a won position and the slowest is that far
+	everything closer to the end was settled before, so a value, once
+	set, is the real distance
+*/
+static void *
+tb_settle_thread(void *arg){
+
+	TBWork *work = arg;
+	TBGen *gen = work->gen;
+	int d = work->distance;
+
+	for (uint64_t i = work->begin; i<work->end; ++i) {
+		if (gen->value[i] != TB_DRAW) continue;
+
+		bool lost = gen->win[i] == TB_NONE && gen->open[i] == 0 && gen->loss[i] != TB_NONE;
+		int at = gen->win[i] != TB_NONE ? gen->win[i] : lost ? gen->loss[i] : -1;
+
+		if (at < 0) continue;
+		// it would need a distance the values can't hold
+		if (d > TB_MAX_DISTANCE) {
+			work->failed = true;
+			continue;
+		}
+		if (at != d) {
+			work->pending++;
+			continue;
+		}
+
+		gen->value[i] = gen->win[i] != TB_NONE ? TB_WIN(d) : TB_LOSS(d);
+		work->settled++;
+	}
+
+	return NULL;
+}
+
+/*
+	tells the positions that can move to the ones settled at "distance"
+	what they lead to: the predecessors are found by unmoving the pieces
+	of the side that just moved one square (captures and promotions come
+	from other slices), and an unmove only counts if the move was legal,
+	so the side can't have had a capture
+
+	a settled loss gives its predecessors a win one ply further, a settled
+	win takes one of their open moves away and may make them lose more slowly
+	all the threads write the same distance this round, so only "open"
+	needs an atomic
+*/
+static void *
+tb_propagate_thread(void *arg){
+
+	TBWork *work = arg;
+	TBGen *gen = work->gen;
+	uint8_t next = work->distance + 1;
+
+	for (uint64_t i = work->begin; i<work->end; ++i) {
+		uint8_t value = gen->value[i];
+		// (a win in 0 would be TB_DRAW)
+		if (!TB_IS_WIN(value) && !TB_IS_LOSS(value)) continue;
+		if (TB_DISTANCE(value) != work->distance) continue;
+
+		COLOR turn = i < gen->size ? BLACK : WHITE;
+		COLOR mover = !turn;
+		Position pos;
+
+		tb_unindex(i - turn * gen->size, gen->counts, turn, &pos);
+		Bitboard empty = ~(pos.pieces[BLACK] | pos.pieces[WHITE]);
+		Bitboard pieces = pos.pieces[mover];
+
+		while (pieces) {
+			Bitboard to = pieces & -pieces;
+			bool king = pos.kings & to;
+			pieces &= pieces - 1;
+
+			for (int d = 0; d<4; ++d) {
+				// men only move forward: black goes south, white goes north
+				if (!king && (mover == BLACK) != (d == SW || d == SE)) continue;
+				Bitboard from = bb_step(to, OPPOSITE_DIRECTION(d)) & empty;
+				if (!from) continue;
+
+				Position prev = pos;
+				prev.pieces[mover] ^= from | to;
+				if (king) prev.kings ^= from | to;
+				prev.turn = mover;
+				if (taking_available(&prev, mover)) continue;
+
+				uint64_t p = mover * gen->size + tb_index(&prev, gen->counts);
+				if (gen->value[p] != TB_DRAW) continue;
+
+				if (TB_IS_LOSS(value)) {
+					if (__atomic_load_n(&(gen->win[p]), __ATOMIC_RELAXED) > next)
+						__atomic_store_n(&(gen->win[p]), next, __ATOMIC_RELAXED);
+				}
+				else {
+					__atomic_fetch_sub(&(gen->open[p]), 1, __ATOMIC_RELAXED);
+					uint8_t loss = __atomic_load_n(&(gen->loss[p]), __ATOMIC_RELAXED);
+					if (loss != TB_NONE && loss < next)
+						__atomic_store_n(&(gen->loss[p]), next, __ATOMIC_RELAXED);
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* runs "fn" on all the positions of the slice, split between the threads */
+static void
+tb_run(TBGen *gen, int threads, void *(*fn)(void *), int distance, TBWork *total){
+
+	pthread_t handles[MAX_THREADS];
+	TBWork work[MAX_THREADS];
+	uint64_t chunk = (2 * gen->size + threads - 1) / threads;
+
+	for (int t = 0; t<threads; ++t) {
+		memset(&(work[t]), 0, sizeof work[t]);
+		work[t].gen = gen;
+		work[t].begin = t * chunk < 2 * gen->size ? t * chunk : 2 * gen->size;
+		work[t].end = work[t].begin + chunk < 2 * gen->size ? work[t].begin + chunk : 2 * gen->size;
+		work[t].distance = distance;
+	}
+	for (int t = 1; t<threads; ++t)
+		pthread_create(&(handles[t]), NULL, fn, &(work[t]));
+	fn(&(work[0]));
+	for (int t = 1; t<threads; ++t)
+		pthread_join(handles[t], NULL);
+
+	memset(total, 0, sizeof *total);
+	for (int t = 0; t<threads; ++t) {
+		total->settled += work[t].settled;
+		total->pending += work[t].pending;
+		total->failed |= work[t].failed;
+	}
+}
+
+static bool
+tb_write_slice(const TBGen *gen){
+
+	char path[300];
+	TBHeader header;
+
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, TB_MAGIC, 4);
+	header.version = TB_VERSION;
+	for (int i = 0; i<4; ++i) header.counts[i] = gen->counts[i];
+	header.size = gen->size;
+
+	slice_path(gen->counts, path, sizeof path);
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) return false;
+
+	bool ok = fwrite(&header, sizeof header, 1, f) == 1 &&
+	          fwrite(gen->value, 1, 2 * gen->size, f) == 2 * gen->size;
+
+	return fclose(f) == 0 && ok;
+}
+
+/* solves one slice (everything it can reach has to be solved already) */
+static bool
+tb_generate_slice(const int counts[4], int threads){
+
+	TBGen gen;
+	TBWork total;
+	uint64_t wins = 0, losses = 0, draws = 0;
+	double start = clock_seconds();
+	int distance;
+	bool ok = true;
+
+	memcpy(gen.counts, counts, sizeof gen.counts);
+	gen.size = slice_size(counts);
+	gen.value = malloc(2 * gen.size);
+	gen.open = malloc(2 * gen.size);
+	gen.win = malloc(2 * gen.size);
+	gen.loss = malloc(2 * gen.size);
+	if (!gen.value || !gen.open || !gen.win || !gen.loss) {
+		free(gen.value);
+		free(gen.open);
+		free(gen.win);
+		free(gen.loss);
+		return false;
+	}
+
+	tb_run(&gen, threads, tb_init_thread, 0, &total);
+
+	// distance N settles the positions won or lost in N plies and hands them on
+	for (distance = 0; ; ++distance) {
+		tb_run(&gen, threads, tb_settle_thread, distance, &total);
+		if (total.failed) {
+			printf("%d%d%d%d: a position is more than %d plies from the end, that doesn't fit\n",
+			       counts[0], counts[1], counts[2], counts[3], TB_MAX_DISTANCE);
+			ok = false;
+			break;
+		}
+		// nothing was settled and nothing is waiting, the rest are draws
+		if (total.settled == 0 && total.pending == 0) break;
+
+		tb_run(&gen, threads, tb_propagate_thread, distance, &total);
+	}
+
+	for (uint64_t i = 0; i<2 * gen.size; ++i) {
+		if (TB_IS_WIN(gen.value[i]))       wins++;
+		else if (TB_IS_LOSS(gen.value[i])) losses++;
+		else if (gen.value[i] == TB_DRAW)  draws++;
+	}
+
+	if (ok) {
+		ok = tb_write_slice(&gen);
+		printf("%d%d%d%d: %llu positions, %llu wins, %llu losses, %llu draws, longest %d plies, %.2f s%s\n",
+		       counts[0], counts[1], counts[2], counts[3], (unsigned long long)(2 * gen.size),
+		       (unsigned long long)wins, (unsigned long long)losses, (unsigned long long)draws,
+		       distance - 1, clock_seconds() - start, ok ? "" : " (couldn't write the file!)");
+	}
+	fflush(stdout);
+
+	free(gen.value);
+	free(gen.open);
+	free(gen.win);
+	free(gen.loss);
+
+	return ok;
+}
+
+/*
+	generates every slice with at most "pieces" pieces into "dir"
+	in an order where captures and promotions only lead to finished slices:
+	fewer pieces first, and for the same number of pieces fewer men first
+	only one slice is in memory at a time, the finished ones are mapped
+*/
+bool
+tb_generate(const char *dir, int pieces, int threads){
+
+	if (pieces > TB_MAX_PIECES) pieces = TB_MAX_PIECES;
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+	mkdir(dir, 0755);
+	tb_init(dir, pieces);
+
+	for (int total = 2; total<=pieces; ++total)
+	for (int men = 0; men<=total; ++men)
+	for (int bm = 0; bm<=men; ++bm)
+	for (int bk = 0; bk<=total - men; ++bk) {
+		int counts[4] = { bm, bk, men - bm, total - men - bk };
+		char path[300];
+		struct stat st;
+
+		if (counts[0] + counts[1] == 0 || counts[2] + counts[3] == 0) continue;
+
+		// already there from an earlier run
+		slice_path(counts, path, sizeof path);
+		if (stat(path, &st) == 0) continue;
+
+		if (!tb_generate_slice(counts, threads)) return false;
+	}
+
+	return true;
+}
+
+/*
+	checkers tbgen <pieces> [threads] [dir]
+	checkers tbprobe <FEN> [dir]
+*/
+int
+tb_main(int argc, char *argv[]){
+
+	if (argc >= 2 && strcmp(argv[0], "tbgen") == 0) {
+		int pieces = atoi(argv[1]);
+		int threads = argc >= 3 ? atoi(argv[2]) : 1;
+		const char *dir = argc >= 4 ? argv[3] : "tb";
+
+		double start = clock_seconds();
+		bool ok = tb_generate(dir, pieces, threads);
+		printf("%s in %.2f s\n", ok ? "done" : "failed", clock_seconds() - start);
+		tb_close();
+		return ok ? 0 : 1;
+	}
+
+	if (argc >= 2 && strcmp(argv[0], "tbprobe") == 0) {
+		Position pos;
+		uint8_t value;
+		char notation[4 * (MAX_CAPTURES + 1)];
+
+		if (!position_from_fen(&pos, argv[1])) {
+			printf("Invalid FEN: %s\n", argv[1]);
+			return 1;
+		}
+		tb_init(argc >= 3 ? argv[2] : "tb", TB_MAX_PIECES);
+
+		if (!tb_probe(&pos, &value))
+			printf("not in the tablebases\n");
+		else {
+			if (TB_IS_WIN(value))       printf("win in %d plies\n", TB_DISTANCE(value));
+			else if (TB_IS_LOSS(value)) printf("loss in %d plies\n", TB_DISTANCE(value));
+			else                        printf("draw\n");
+
+			// and what every move leads to
+			MoveBuf buf;
+			generate_moves(&pos, pos.turn, &buf);
+			for (int i = 0; i<buf.len; ++i) {
+				Position child = pos;
+				position_apply(&child, buf.moves[i]);
+				move_format_path(buf.moves[i], notation);
+				if (!tb_probe(&child, &value))  printf("  %-12s ?\n", notation);
+				else if (TB_IS_WIN(value))      printf("  %-12s loss in %d\n", notation, TB_DISTANCE(value) + 1);
+				else if (TB_IS_LOSS(value))     printf("  %-12s win in %d\n", notation, TB_DISTANCE(value) + 1);
+				else                            printf("  %-12s draw\n", notation);
+			}
+		}
+
+		tb_close();
+		return 0;
+	}
+
+	printf("usage: checkers tbgen <pieces> [threads] [dir]\n"
+	       "       checkers tbprobe <FEN> [dir]\n");
+	return 1;
+}
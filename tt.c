@@ -0,0 +1,238 @@
+#include "checkers.h"
+
+/*
+	the transposition table
+
+	a power of two number of 64 byte buckets (one cache line each),
+	a position's bucket comes from the low bits of its hash
+	the first TT_BUCKET-1 slots of a bucket keep the deepest results
+	(or the ones from older searches get thrown out first),
+	the last slot always takes whatever didn't make it into the others
+
+	all the search threads use it at the same time without locking:
+	a slot holds the packed entry and the key xor'd with it, so if two
+	threads write the same slot at once the halves won't match and the
+	probe just misses
+*/
+
+static TTBucket *tt_table = NULL;
+static uint64_t tt_mask = 0;
+static uint8_t tt_generation = 0;
+
+// how much a search older than the current one counts against an entry
+#define TT_AGE_PENALTY 8
+
+#define LOAD(X)		__atomic_load_n(&(X), __ATOMIC_RELAXED)
+#define STORE(X, V)	__atomic_store_n(&(X), (V), __ATOMIC_RELAXED)
+
+static uint64_t
+tt_pack(const TTEntry *e){
+	return (uint64_t)(uint16_t)e->score
+	     | (uint64_t)(uint8_t)e->depth << 16
+	     | (uint64_t)e->bound << 24
+	     | (uint64_t)e->generation << 32
+	     | (MOVE_ENDS(e->move) >> 32) << 40;
+}
+
+static void
+tt_unpack(uint64_t data, TTEntry *e){
+	e->score = (int16_t)(data & 0xFFFF);
+	e->depth = (int8_t)(data >> 16);
+	e->bound = (data >> 24) & 0xFF;
+	e->generation = (data >> 32) & 0xFF;
+	e->move = ((data >> 40) & 0xFFF) << 32;
+}
+
+/* (re)allocates the table with as many buckets as fit into "mb" megabytes */
+bool
+tt_init(size_t mb){
+
+	size_t buckets = 1;
+	while (buckets * 2 * sizeof(TTBucket) <= mb * 1024 * 1024)
+		buckets *= 2;
+
+	free(tt_table);
+	tt_table = malloc(buckets * sizeof(TTBucket));
+	if (tt_table == NULL) {
+		tt_mask = 0;
+		return false;
+	}
+
+	tt_mask = buckets - 1;
+	tt_clear();
+
+	return true;
+}
+
+void
+tt_free(void){
+	free(tt_table);
+	tt_table = NULL;
+	tt_mask = 0;
+}
+
+bool
+tt_ready(void){
+	return tt_table != NULL;
+}
+
+size_t
+tt_size_bytes(void){
+	return tt_table ? (tt_mask + 1) * sizeof(TTBucket) : 0;
+}
+
+void
+tt_clear(void){
+	if (tt_table)
+		memset(tt_table, 0, (tt_mask + 1) * sizeof(TTBucket));
+	tt_generation = 0;
+}
+
+/*
+	called once per search (before the threads start)
+	so the entries of older searches get replaced first
+	the self-play workers' engines share the table, so this can race with itself
+*/
+void
+tt_new_search(void){
+	__atomic_add_fetch(&tt_generation, 1, __ATOMIC_RELAXED);
+}
+
+/*
+	mate (and tablebase) scores are stored as "win in N from this node" rather than
+	"from the root", so they stay right when reached through another path
+*/
+int
+tt_score_to(int score, int ply){
+	if (score >= SCORE_DECISIVE)  return score + ply;
+	if (score <= -SCORE_DECISIVE) return score - ply;
+	return score;
+}
+
+int
+tt_score_from(int score, int ply){
+	if (score >= SCORE_DECISIVE)  return score - ply;
+	if (score <= -SCORE_DECISIVE) return score + ply;
+	return score;
+}
+
+/*
+	copies the entry for "key" into "out", returns false if there is none
+	"stats" belongs to the calling thread (or is NULL)
+*/
+bool
+tt_probe(uint64_t key, TTEntry *out, TTStats *stats){
+
+	if (tt_table == NULL) return false;
+
+	TTBucket *bucket = &(tt_table[key & tt_mask]);
+	if (stats) stats->probes++;
+
+	for (int i = 0; i<TT_BUCKET; ++i) {
+		uint64_t data = LOAD(bucket->slots[i].data);
+		if ((LOAD(bucket->slots[i].check) ^ data) == key) {
+			tt_unpack(data, out);
+			if (stats) stats->hits++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int
+tt_worth(uint64_t data){
+	TTEntry e;
+	tt_unpack(data, &e);
+	return e.depth - TT_AGE_PENALTY * (uint8_t)(LOAD(tt_generation) - e.generation);
+}
+
+void
+tt_store(uint64_t key, int depth, int bound, int score, Move best, TTStats *stats){
+
+	if (tt_table == NULL) return;
+
+	TTBucket *bucket = &(tt_table[key & tt_mask]);
+	TTSlot *slot = NULL;
+	TTEntry e;
+
+	if (stats) stats->stores++;
+
+	if (depth < 0) depth = 0;
+
+	for (int i = 0; i<TT_BUCKET; ++i)
+		if ((LOAD(bucket->slots[i].check) ^ LOAD(bucket->slots[i].data)) == key)
+			slot = &(bucket->slots[i]);
+
+	if (slot) {
+		TTEntry old;
+		tt_unpack(LOAD(slot->data), &old);
+		// don't let a shallow result push out a deeper one for the same position
+		if (bound != TT_EXACT && depth < old.depth && old.generation == LOAD(tt_generation))
+			return;
+		// keep the old move if the new result doesn't have one
+		if (best == MOVE_NONE)
+			best = old.move;
+	}
+	else {
+		// depth preferred: the least useful of the first slots...
+		slot = &(bucket->slots[0]);
+		for (int i = 1; i<TT_BUCKET - 1; ++i)
+			if (tt_worth(LOAD(bucket->slots[i].data)) < tt_worth(LOAD(slot->data)))
+				slot = &(bucket->slots[i]);
+
+		// ...unless it's worth more than this, then the always replace one
+		if (tt_worth(LOAD(slot->data)) > depth)
+			slot = &(bucket->slots[TT_BUCKET - 1]);
+		else if (LOAD(slot->check) && stats)
+			stats->overwrites++;
+	}
+
+	e.score = score;
+	e.depth = depth;
+	e.bound = bound;
+	e.generation = LOAD(tt_generation);
+	e.move = MOVE_ENDS(best);
+
+	uint64_t data = tt_pack(&e);
+	STORE(slot->data, data);
+	STORE(slot->check, key ^ data);
+}
+
+/* how many of the first 1000 slots (250 buckets) are used by the current search, in permille */
+int
+tt_hashfull(void){
+
+	if (tt_table == NULL) return 0;
+
+	uint64_t buckets = tt_mask + 1 < 1000 / TT_BUCKET ? tt_mask + 1 : 1000 / TT_BUCKET;
+	int used = 0;
+
+	for (uint64_t b = 0; b<buckets; ++b)
+		for (int i = 0; i<TT_BUCKET; ++i) {
+			TTEntry e;
+			tt_unpack(LOAD(tt_table[b].slots[i].data), &e);
+			if (LOAD(tt_table[b].slots[i].check) && e.generation == LOAD(tt_generation))
+				used++;
+		}
+
+	return used * 1000 / (buckets * TT_BUCKET);
+}
+
+void
+tt_stats_add(TTStats *sum, const TTStats *stats){
+	sum->probes += stats->probes;
+	sum->hits += stats->hits;
+	sum->stores += stats->stores;
+	sum->overwrites += stats->overwrites;
+}
+
+void
+tt_print_stats(const TTStats *stats){
+	printf("tt: %zu MB, %llu probes, %llu hits (%.1f%%), %llu stores, %llu overwrites, %d permille full\n",
+	       tt_size_bytes() / (1024 * 1024),
+	       (unsigned long long)stats->probes, (unsigned long long)stats->hits,
+	       stats->probes ? 100.0 * stats->hits / stats->probes : 0.0,
+	       (unsigned long long)stats->stores, (unsigned long long)stats->overwrites,
+	       tt_hashfull());
+}